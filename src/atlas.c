@@ -0,0 +1,308 @@
+#include <string.h>
+
+#include "soil/SOIL.h"
+
+#include "util.h"
+#include "atlas.h"
+#include "jobs.h"
+#include "trace.h"
+
+/**
+   Transparent space kept to the left of and above every image, so linear
+   filtering never picks up a neighbour.  Being a multiple of 4 keeps every
+   image on its own DXT blocks too.
+*/
+#define ATLAS_PADDING 4
+
+/**
+   One segment of the skyline: the top of everything packed so far between
+   x and x + width.
+*/
+typedef struct skyline_node {
+  int x;
+  int y;
+  int width;
+} skyline_node_t;
+
+/**
+   Images being decoded for an atlas, one job per image.
+*/
+typedef struct atlas_images {
+  const char**    filenames;
+  unsigned char** images;
+  rect_t*         areas;
+  /** SOIL's reason for each image that failed to decode. */
+  const char**    errors;
+} atlas_images_t;
+
+typedef struct skyline {
+  skyline_node_t* nodes;
+  int             count;
+
+  int             width;
+  int             height;
+} skyline_t;
+
+static int
+align_to_padding(int value) {
+  return (value + ATLAS_PADDING - 1) / ATLAS_PADDING * ATLAS_PADDING;
+}
+
+/**
+   Finds where a rectangle would rest if placed at the start of a node.
+
+   @return
+     The y coordinate or -1 if it doesn't fit there.
+*/
+static int
+skyline_fit(skyline_t* sky, int index, int width, int height) {
+  int y = 0;
+  int remaining = width;
+
+  if(sky->nodes[index].x + width > sky->width) {
+    return -1;
+  }
+
+  for(int i = index; remaining > 0; i++) {
+    y = max(y, sky->nodes[i].y);
+
+    if(y + height > sky->height) {
+      return -1;
+    }
+
+    remaining -= sky->nodes[i].width;
+  }
+
+  return y;
+}
+
+static void
+skyline_remove(skyline_t* sky, int index) {
+  memmove(sky->nodes + index, sky->nodes + index + 1,
+          (sky->count - index - 1) * sizeof(skyline_node_t));
+  sky->count--;
+}
+
+/**
+   Places a rectangle as low as it will go, preferring the narrowest spot
+   when there is a tie, and raises the skyline over it.
+*/
+static bool
+skyline_add(skyline_t* sky, int width, int height, point_t* position) {
+  int best = -1;
+  int best_y = 0;
+
+  for(int i = 0; i < sky->count; i++) {
+    int y = skyline_fit(sky, i, width, height);
+
+    if(y >= 0 && (best < 0 || y < best_y ||
+                  (y == best_y &&
+                   sky->nodes[i].width < sky->nodes[best].width)))
+    {
+      best = i;
+      best_y = y;
+    }
+  }
+
+  if(best >= 0) {
+    position->x = sky->nodes[best].x;
+    position->y = best_y;
+
+    memmove(sky->nodes + best + 1, sky->nodes + best,
+            (sky->count - best) * sizeof(skyline_node_t));
+    sky->count++;
+    sky->nodes[best].y = best_y + height;
+    sky->nodes[best].width = width;
+
+    // Cut back the nodes the new one now covers.
+    while(best + 1 < sky->count) {
+      skyline_node_t* node = sky->nodes + best + 1;
+      int             covered = position->x + width - node->x;
+
+      if(covered <= 0) {
+        break;
+      } else if(covered < node->width) {
+        node->x += covered;
+        node->width -= covered;
+        break;
+      }
+
+      skyline_remove(sky, best + 1);
+    }
+
+    // Join neighbours at the same height.
+    for(int i = 0; i + 1 < sky->count;) {
+      if(sky->nodes[i].y == sky->nodes[i + 1].y) {
+        sky->nodes[i].width += sky->nodes[i + 1].width;
+        skyline_remove(sky, i + 1);
+      } else {
+        i++;
+      }
+    }
+  }
+
+  return best >= 0;
+}
+
+/**
+   Packs the images tallest first into a texture of the given size.
+   Fills in the x and y of each area on success.
+*/
+static bool
+pack_areas(rect_t* areas, int* order, int count, skyline_node_t* nodes,
+           int width, int height)
+{
+  skyline_t sky = { nodes, 1, width, height };
+  bool      result = true;
+
+  nodes[0].x = 0;
+  nodes[0].y = 0;
+  nodes[0].width = width;
+
+  for(int i = 0; i < count && result; i++) {
+    rect_t* area = areas + order[i];
+    point_t position = { 0, 0 };
+
+    result = skyline_add(&sky,
+                         align_to_padding(area->width) + ATLAS_PADDING,
+                         align_to_padding(area->height) + ATLAS_PADDING,
+                         &position);
+
+    area->x = position.x + ATLAS_PADDING;
+    area->y = position.y + ATLAS_PADDING;
+  }
+
+  return result;
+}
+
+static void
+decode_images(void* data, int start, int end) {
+  atlas_images_t* decode = data;
+
+  for(int i = start; i < end; i++) {
+    int channels;
+
+    trace_begin("image_decode");
+    decode->images[i] = SOIL_load_image(decode->filenames[i],
+                                        &decode->areas[i].width,
+                                        &decode->areas[i].height,
+                                        &channels, SOIL_LOAD_RGBA);
+    if(decode->images[i] == NULL) {
+      decode->errors[i] = SOIL_last_result();
+    }
+    trace_end("image_decode");
+  }
+}
+
+atlas_t*
+atlas_load(const char** filenames, int count, bool intern) {
+  atlas_t*        atlas = NULL;
+  unsigned char** images = new_array(unsigned char*, count);
+  rect_t*         areas = new_array(rect_t, count);
+  int*            order = new_array(int, count);
+  skyline_node_t* nodes = new_array(skyline_node_t, count + 2);
+  const char**    errors = new_array(const char*, count);
+  atlas_images_t  decode = { filenames, images, areas, errors };
+  bool            loaded = true;
+  bool            packed = false;
+  int             width = 64;
+  int             height = 64;
+
+  trace_begin("atlas_load");
+
+  jobs_parallel_for(decode_images, &decode, count, 1);
+
+  for(int i = 0; i < count; i++) {
+    if(images[i] == NULL) {
+      logmsg("Unable to load %s into the atlas.  Error: %s", filenames[i],
+             errors[i]);
+      loaded = false;
+    }
+  }
+
+  // Tallest first packs tightest on a skyline.  The lists are short.
+  for(int i = 0; i < count; i++) {
+    int j = i;
+
+    for(; j > 0 && areas[order[j - 1]].height < areas[i].height; j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  // Grow a power of two texture, widest first, until everything fits.
+  trace_begin("atlas_pack");
+  while(loaded && !packed && width <= ATLAS_MAX_SIZE &&
+        height <= ATLAS_MAX_SIZE)
+  {
+    packed = pack_areas(areas, order, count, nodes, width, height);
+
+    if(!packed) {
+      if(width <= height) {
+        width *= 2;
+      } else {
+        height *= 2;
+      }
+    }
+  }
+
+  trace_end("atlas_pack");
+
+  if(loaded && !packed) {
+    logmsg("Atlas images don't fit in %dx%d.", ATLAS_MAX_SIZE,
+           ATLAS_MAX_SIZE);
+  }
+
+  if(packed) {
+    unsigned char* pixels = new_array(unsigned char, width * height * 4);
+
+    for(int i = 0; i < count; i++) {
+      rect_t* area = areas + i;
+
+      for(int y = 0; y < area->height; y++) {
+        memcpy(pixels + ((area->y + y) * width + area->x) * 4,
+               images[i] + y * area->width * 4, area->width * 4);
+      }
+    }
+
+    atlas = new(atlas_t);
+    atlas->texture = texture_create(pixels, width, height, intern);
+    atlas->areas = areas;
+    atlas->count = count;
+    delete(pixels);
+
+    if(atlas->texture == NULL) {
+      logmsg("Unable to create the %dx%d atlas texture.", width, height);
+      delete(atlas);
+      atlas = NULL;
+    } else {
+      logmsg("Packed %d images into a %dx%d atlas, texture id %u.", count,
+             width, height, atlas->texture->id);
+    }
+  }
+
+  for(int i = 0; i < count; i++) {
+    if(images[i] != NULL) {
+      SOIL_free_image_data(images[i]);
+    }
+  }
+
+  if(atlas == NULL) {
+    delete(areas);
+  }
+
+  delete(errors);
+  delete(nodes);
+  delete(order);
+  delete(images);
+
+  trace_end("atlas_load");
+
+  return atlas;
+}
+
+void
+atlas_delete(atlas_t* atlas) {
+  delete(atlas->areas);
+  delete(atlas);
+}
@@ -0,0 +1,48 @@
+/**
+   @file atlas.h
+
+   Packs small images into one texture at startup so everything drawn from
+   them can share a single texture bind and stay in one sprite batch.
+*/
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "gfx.h"
+
+/** Largest atlas texture that will be built, in pixels per side. */
+#define ATLAS_MAX_SIZE 4096
+
+/**
+   A texture holding several packed images.
+*/
+typedef struct atlas {
+  texture_t* texture;
+
+  /** Area each image was packed into, in the order the files were given. */
+  rect_t*    areas;
+  int        count;
+} atlas_t;
+
+/**
+   Loads images and packs them into a new atlas texture.
+
+   @param filenames
+     Images to pack.
+   @param count
+     Number of images.
+   @param intern
+     Whether the atlas texture is cleaned up on close of the application.
+   @return
+     A new atlas or NULL if an image could not be loaded or the images don't
+     fit in ATLAS_MAX_SIZE.
+*/
+atlas_t*
+atlas_load(const char** filenames, int count, bool intern);
+
+/**
+   Cleans up an atlas.  Like a sprite sheet, the texture is left alone.
+*/
+void
+atlas_delete(atlas_t* atlas);
+
+#endif
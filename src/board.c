@@ -0,0 +1,183 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+
+#define CELL_BITS 5
+#define CELL_MASK ((uint64_t)0x1F)
+#define CELLS_PER_WORD 12
+
+#define CELL_WORD(cell)  ((cell) / CELLS_PER_WORD)
+#define CELL_SHIFT(cell) (((cell) % CELLS_PER_WORD) * CELL_BITS)
+
+bool
+board_init(board_t* board, int size) {
+  bool result = size >= 2 && size <= BOARD_MAX_SIZE;
+
+  if(result) {
+    memset(board, 0, sizeof(board_t));
+    board->size = size;
+    board->blank = 0;
+
+    for(int cell = 0; cell < size * size; cell++) {
+      board_set(board, cell, cell);
+    }
+  }
+
+  return result;
+}
+
+int
+board_get(const board_t* board, int cell) {
+  return (board->words[CELL_WORD(cell)] >> CELL_SHIFT(cell)) & CELL_MASK;
+}
+
+void
+board_set(board_t* board, int cell, int tile) {
+  uint64_t* word = board->words + CELL_WORD(cell);
+
+  *word = (*word & ~(CELL_MASK << CELL_SHIFT(cell))) |
+    ((uint64_t)tile << CELL_SHIFT(cell));
+}
+
+bool
+board_move(board_t* board, direction_t direction) {
+  int  size = board->size;
+  int  blank = board->blank;
+  int  x = blank % size;
+  int  y = blank / size;
+  int  source = -1;
+
+  // Find the tile that slides into the blank
+  switch(direction) {
+  case DIRECTION_UP:    if(y < size - 1) source = blank + size; break;
+  case DIRECTION_DOWN:  if(y > 0)        source = blank - size; break;
+  case DIRECTION_LEFT:  if(x < size - 1) source = blank + 1;    break;
+  case DIRECTION_RIGHT: if(x > 0)        source = blank - 1;    break;
+  }
+
+  if(source >= 0) {
+    uint64_t tile = board_get(board, source);
+
+    // The blank holds zero so the tile can be or'ed straight in.
+    board->words[CELL_WORD(blank)] |= tile << CELL_SHIFT(blank);
+    board->words[CELL_WORD(source)] &= ~(CELL_MASK << CELL_SHIFT(source));
+    board->blank = source;
+  }
+
+  return source >= 0;
+}
+
+bool
+board_apply_moves(board_t* board, const char* moves, size_t* applied) {
+  bool   result = true;
+  size_t count = 0;
+
+  for(; moves[count] != '\0' && result; count++) {
+    direction_t direction;
+
+    switch(moves[count]) {
+    case 'U': case 'u': direction = DIRECTION_UP;    break;
+    case 'D': case 'd': direction = DIRECTION_DOWN;  break;
+    case 'L': case 'l': direction = DIRECTION_LEFT;  break;
+    case 'R': case 'r': direction = DIRECTION_RIGHT; break;
+    default:
+      result = false;
+      continue;
+    }
+
+    result = board_move(board, direction);
+  }
+
+  if(applied != NULL) {
+    *applied = result ? count : count - 1;
+  }
+
+  return result;
+}
+
+bool
+board_is_solved(const board_t* board) {
+  board_t solved;
+
+  return board->blank == 0 &&
+    board_init(&solved, board->size) &&
+    memcmp(solved.words, board->words, sizeof(solved.words)) == 0;
+}
+
+bool
+board_is_solvable(const board_t* board) {
+  int      cells = board->size * board->size;
+  int      parity = board->blank % board->size + board->blank / board->size;
+  uint32_t visited = 0;
+
+  // A cycle of length n is n - 1 swaps.
+  for(int cell = 0; cell < cells; cell++) {
+    int next = cell;
+
+    while(!(visited & 1u << next)) {
+      visited |= 1u << next;
+      parity += next != cell;
+      next = board_get(board, next);
+    }
+  }
+
+  return parity % 2 == 0;
+}
+
+bool
+board_parse(board_t* board, int size, const char* text) {
+  uint32_t seen = 0;
+  int      cells = size * size;
+  bool     result = board_init(board, size);
+
+  for(int cell = 0; cell < cells && result; cell++) {
+    char* end;
+    long  tile = strtol(text, &end, 10);
+
+    if(end == text || tile < 0 || tile >= cells || (seen & (1u << tile))) {
+      result = false;
+    } else {
+      seen |= 1u << tile;
+      board_set(board, cell, (int)tile);
+
+      if(tile == 0) {
+        board->blank = cell;
+      }
+
+      // Cells are comma separated
+      text = end;
+      if(cell < cells - 1) {
+        result = *text == ',';
+        text++;
+      }
+    }
+  }
+
+  // Only white space may follow the last tile.
+  while(result && *text != '\0') {
+    result = isspace((unsigned char)*text);
+    text++;
+  }
+
+  return result;
+}
+
+size_t
+board_format(const board_t* board, char* buffer, size_t buffer_size) {
+  size_t length = 0;
+
+  for(int cell = 0; cell < board->size * board->size; cell++) {
+    int written = snprintf(buffer + length, buffer_size - length,
+                           cell == 0 ? "%d" : ",%d", board_get(board, cell));
+
+    if(written < 0 || (size_t)written >= buffer_size - length) {
+      break;
+    }
+    length += written;
+  }
+
+  return length;
+}
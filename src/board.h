@@ -0,0 +1,126 @@
+/**
+   @file board.h
+
+   Compact logical model of a sliding tile board.  This carries no graphics
+   state so it can be used by tools that check or replay games quickly.
+
+   Each cell holds the row-major index of the tile's win position, so the
+   solved board is 0, 1, 2, ... and the empty slot (which always belongs in
+   the upper left-hand corner) is 0.  Cells are packed five bits apiece,
+   twelve to a 64-bit word.
+*/
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Largest supported board (matches SKILL_HARD). */
+#define BOARD_MAX_SIZE 5
+
+#define BOARD_MAX_CELLS (BOARD_MAX_SIZE * BOARD_MAX_SIZE)
+
+/** Number of 64-bit words needed to hold every cell. */
+#define BOARD_WORDS 3
+
+/**
+   Direction a tile slides into the empty slot.  Fits in two bits.
+*/
+typedef enum direction {
+  DIRECTION_UP    = 0,
+  DIRECTION_DOWN  = 1,
+  DIRECTION_LEFT  = 2,
+  DIRECTION_RIGHT = 3
+} direction_t;
+
+typedef struct board {
+  uint64_t words[BOARD_WORDS];
+
+  /** Number of tiles wide and high. */
+  uint8_t  size;
+
+  /** Cell index of the empty slot. */
+  uint8_t  blank;
+} board_t;
+
+/**
+   Sets up a solved board.
+
+   @return
+     False if size is out of the supported range.
+*/
+bool
+board_init(board_t* board, int size);
+
+/**
+   Gets the tile stored at a cell index.
+*/
+int
+board_get(const board_t* board, int cell);
+
+/**
+   Stores a tile at a cell index.  The blank position is not updated.
+*/
+void
+board_set(board_t* board, int cell, int tile);
+
+/**
+   Slides the tile next to the empty slot in the given direction.
+
+   @return
+     False if there is no tile that can slide that way.
+*/
+bool
+board_move(board_t* board, direction_t direction);
+
+/**
+   Applies a move string to the board.  Moves are the letters U, D, L and R
+   (either case) naming the direction each tile slides.
+
+   @param applied
+     If not NULL, receives the number of moves applied before the first
+     illegal one (or the string length if all were legal).
+   @return
+     False if a move was illegal.  The board holds the state right before
+     that move.
+*/
+bool
+board_apply_moves(board_t* board, const char* moves, size_t* applied);
+
+/**
+   Checks if every tile is in its win position.
+*/
+bool
+board_is_solved(const board_t* board);
+
+/**
+   Checks if the solved board can be reached from this one.  Each move swaps
+   the blank with a neighbour, so a board is reachable exactly when its
+   permutation, counting the blank, is even or odd along with the blank's
+   distance from its win cell.  The board must hold a permutation.
+*/
+bool
+board_is_solvable(const board_t* board);
+
+/**
+   Parses a board written as comma separated tiles in row-major order, for
+   example "4,1,2,3,0,5,6,7,8" for a 3x3 board.  The tiles must be a
+   permutation of [0, size * size), followed by nothing but white space.
+
+   @return
+     False if the text is not a valid board of that size.
+*/
+bool
+board_parse(board_t* board, int size, const char* text);
+
+/**
+   Writes a board in the format read by board_parse.
+
+   @return
+     Number of characters written, not counting the terminator.
+*/
+size_t
+board_format(const board_t* board, char* buffer, size_t buffer_size);
+
+#endif
@@ -4,6 +4,7 @@
 #include <math.h>
 
 #include "game.h"
+#include "board.h"
 #include "util.h"
 
 //==============================================================================
@@ -20,11 +21,18 @@ const int TIME_WORD_WIDTH = 64;
 const int COUNT_WORD_WIDTH = 80;
 const int COUNT_OFFSET = 256;
 
+const int GAME_UPDATE_RATE = 60;
+
 /** 
-    This is how fast (in pixels per game loop iteration) the tiles move
-    when they slide. 
+    This is how fast (in pixels per second) the tiles move when they slide. 
+*/
+const float SLIDE_VELOCITY = 625.0f;
+
+/**
+   Longest stretch of time one game_update will step through.  After a long
+   stall the game skips ahead instead of running a burst of steps.
 */
-const int SLIDE_VELOCITY = 20;
+const double MAX_UPDATE_DELTA = 0.25;
 
 /**
    Number of times that the board tiles will be moved around before it
@@ -39,6 +47,22 @@ static void swap_tiles(game_t* game, int empty_x, int empty_y, int current_x,
                        int current_y);
 static game_tile_t* get_game_tile(game_t* game, int x, int y);
 
+/**
+   Gets a random number in [min, max) from the game's own xorshift
+   generator.
+*/
+static int
+game_rand_int(game_t* game, int min, int max) {
+  uint32_t x = game->random;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  game->random = x;
+
+  return (x % (max - min)) + min;
+}
+
 static void
 generate_board(game_t* game) {
   int iskill = (int)game->skill;
@@ -53,6 +77,8 @@ generate_board(game_t* game) {
       } else {
         tile->sprite = 
           sprite_sheet_get_sprite(game->board_sheet, x, y);
+        instance_layer_set_source(game->board_layer, x + y * iskill - 1,
+                                  &tile->sprite->area);
       }
 
       tile->win_position.x = x;
@@ -82,7 +108,7 @@ randomize_board_tiles(game_t* game) {
       { empty.x, min(empty.y + 1, game->skill - 1) }
     };
 
-    int index = rand_int(0, 4);
+    int index = game_rand_int(game, 0, 4);
     
     // Swap it
     point_t swap_point = adjacents[index];
@@ -111,7 +137,22 @@ game_new(skill_level_t skill, texture_t* texture) {
   game->scale_width =  TILE_AREA_WIDTH / (texture->width * 1.0f);
   game->scale_height =  TILE_AREA_HEIGHT / (texture->height * 1.0f);
 
-  game->last_update_time = game->time_game_begin = glfwGetTime();
+  game->board_layer = 
+    instance_layer_new(texture, iskill * iskill - 1,
+                       (int)ceil(game->scale_width * sprite_w),
+                       (int)ceil(game->scale_height * sprite_h));
+
+  game->viewport.x = 0;
+  game->viewport.y = HEIGHT_OFFSET;
+  game->viewport.width = TILE_AREA_WIDTH;
+  game->viewport.height = TILE_AREA_HEIGHT;
+
+  game->time_game_begin = gfx_get_time();
+  game->step_length = 1.0 / GAME_UPDATE_RATE;
+  game->needs_render = true;
+
+  // Seeded from rand so every game gets its own sequence.
+  game->random = (uint32_t)rand() * 2654435761u | 1;
 
   generate_board(game);
   randomize_board_tiles(game);
@@ -125,6 +166,7 @@ game_end(game_t* game) {
   delete(game->board);
 
   // Remove the graphics resources
+  instance_layer_delete(game->board_layer);
   sprite_sheet_delete(game->board_sheet);
 
   // Clean up memory
@@ -139,39 +181,95 @@ static void
 draw_game_board(game_t* game) {
   // Calculate the destination.  We have to scale the individual sprites
   // to the screen's resolution.
-  int width = (int)ceil(game->scale_width * game->board_sheet->sprite_width);
-  int height = (int)ceil(game->scale_height * game->board_sheet->sprite_height);
+  int   width = game->board_layer->width;
+  int   height = game->board_layer->height;
+  float blend = game->step_accumulator / game->step_length;
+  float slide = game->previous_slide + 
+    (game->slide - game->previous_slide) * blend;
+  int   slide_x = lroundf(slide * game->slide_direction.x);
+  int   slide_y = lroundf(slide * game->slide_direction.y);
+
+  // A click is seen once its tiles are a pixel along, or already home.
+  if(game->input_time > 0.0 &&
+     (slide_x != 0 || slide_y != 0 ||
+      game->play_state != PLAY_STATE_MOVING_TILE))
+  {
+    game->input_shown = true;
+  }
   
+  // Instances only go to the renderer again when they move, so this is
+  // normally just the sliding run of tiles.
   for(int x = 0; x < game->skill; x++) {
     for(int y = 0; y < game->skill; y++) {
       game_tile_t* tile = get_game_tile(game, x, y);
-      sprite_t* sprite = tile->sprite;
-
-      if(sprite != NULL) {
-        // Stationary sprites
-        if(tile->velocity.x != 0 && tile->velocity.y != 0) {
-          rect_t dest = { x * width, 
-                          y * height + HEIGHT_OFFSET, 
-                          width, height };
-          sprite_render(sprite, &dest, NULL);
+
+      if(tile->sprite != NULL) {
+        int index = tile->win_position.x + 
+          tile->win_position.y * game->skill - 1;
+
+        if(tile->sliding) {
+          instance_layer_move(game->board_layer, index,
+                              game->viewport.x + x * width + slide_x,
+                              game->viewport.y + y * height + slide_y);
+        } else {
+          instance_layer_move(game->board_layer, index,
+                              game->viewport.x + x * width,
+                              game->viewport.y + y * height);
         }
+      }
+    }
+  }
+
+  instance_layer_render(game->board_layer);
+}
+
+void
+game_set_viewport(game_t* game, rect_t* viewport) {
+  game->viewport = *viewport;
+  game->needs_render = true;
+}
 
-      
-        // Moving sprite
-        else {
-          rect_t dest = { x * width + tile->pixel_offset.x, 
-                          y * height + tile->pixel_offset.y + HEIGHT_OFFSET, 
-                          width, height };
-          sprite_render(sprite, &dest, NULL);
+void
+game_add_board_quads(game_t* game, quad_run_t* run) {
+  float blend = game->step_accumulator / game->step_length;
+  float slide = game->previous_slide + 
+    (game->slide - game->previous_slide) * blend;
+  float width = game->viewport.width / (float)game->skill;
+  float height = game->viewport.height / (float)game->skill;
+  float slide_x = slide * game->slide_direction.x * 
+    game->viewport.width / TILE_AREA_WIDTH;
+  float slide_y = slide * game->slide_direction.y * 
+    game->viewport.height / TILE_AREA_HEIGHT;
+
+  for(int x = 0; x < game->skill; x++) {
+    for(int y = 0; y < game->skill; y++) {
+      game_tile_t* tile = get_game_tile(game, x, y);
+
+      if(tile->sprite != NULL) {
+        rect_t dest;
+
+        // Cells are placed by their edges so neighbours meet exactly.
+        dest.x = game->viewport.x + lroundf(x * width);
+        dest.y = game->viewport.y + lroundf(y * height);
+        dest.width = game->viewport.x + lroundf((x + 1) * width) - dest.x;
+        dest.height = game->viewport.y + lroundf((y + 1) * height) - dest.y;
+
+        if(tile->sliding) {
+          dest.x += lroundf(slide_x);
+          dest.y += lroundf(slide_y);
         }
+
+        quad_run_add_sprite(run, tile->sprite, &dest, NULL);
       }
     }
   }
+
+  game->needs_render = false;
 }
 
 /**
-   Draws a given number of digits.  This will draw the number and pad any
-   empty spaces with zeros.
+   Adds a given number of digits to the hud.  This will add the number and
+   pad any empty spaces with zeros.
    @param start_x
      Where to start drawing on the hud, x coordinate.
    @param num
@@ -183,86 +281,118 @@ draw_game_board(game_t* game) {
      Color to draw it in.
 */
 static void
-draw_digits(app_data_t* app, game_t* game, int start_x, int num, int count,
-            color_t* color) 
-{
+add_digits(app_data_t* app, int start_x, int num, int count, color_t* color) {
   for(int i = count - 1; i >= 0; i--) {
     sprite_t* sprite;
     rect_t dest = { start_x + i * app->digits->sprite_width, 4, 
                     0, 0 };
 
     sprite = sprite_sheet_get_sprite(app->digits, num % 10, 0);
-    sprite_render(sprite, &dest, color);
+    quad_run_add_sprite(app->hud, sprite, &dest, color);
 
     num /= 10;
   }
 }
 
 static void
-draw_hud_words(app_data_t* app) {
+add_hud_words(app_data_t* app) {
   rect_t dest = { 0, 4, 0, 0 };
-  rect_t src = { 0, 0, TIME_WORD_WIDTH, 24 };
+  rect_t src = { app->hud_words.area.x, app->hud_words.area.y,
+                 TIME_WORD_WIDTH, 24 };
   color_t green = { 0, 255, 0, 255 };
 
   // Draw time
-  gfx_blit(app->hud_words, &src, &dest, &green);
+  quad_run_add(app->hud, &src, &dest, &green);
 
   // Draw 'count'
   dest.x = COUNT_OFFSET;
-  src.x = TIME_WORD_WIDTH;
+  src.x += TIME_WORD_WIDTH;
   src.width = COUNT_WORD_WIDTH;
 
-  gfx_blit(app->hud_words, &src, &dest, &green);
+  quad_run_add(app->hud, &src, &dest, &green);
+}
+
+/**
+   Number of whole seconds shown on the clock.
+*/
+static int
+get_clock_seconds(game_t* game) {
+  return (int)(game->play_time - game->time_game_begin);
 }
 
 static void
-draw_current_time(app_data_t* app, game_t* game) {
+add_current_time(app_data_t* app, int time) {
   color_t   green = { 0, 255, 0, 255 };
   color_t   gray  = { 64, 64, 64, 255 };
-  int       time;
   int       seconds;
   int       minutes;
   sprite_t* colon;
   rect_t    dest = { 48 + TIME_WORD_WIDTH + 4, 4, 0, 0 };
 
-  time = (int)(game->play_time - game->time_game_begin);
-
   seconds = time % 60;
   minutes = time / 60;
 
-  draw_digits(app, game, 16 + TIME_WORD_WIDTH, 88, 2, &gray);
-  draw_digits(app, game, 16 + TIME_WORD_WIDTH, minutes, 2, &green);
+  add_digits(app, 16 + TIME_WORD_WIDTH, 88, 2, &gray);
+  add_digits(app, 16 + TIME_WORD_WIDTH, minutes, 2, &green);
   
   // Draw colon
   colon = sprite_sheet_get_sprite(app->digits, 10, 0);
-  sprite_render(colon, &dest, &green);
+  quad_run_add_sprite(app->hud, colon, &dest, &green);
 
-  draw_digits(app, game, 64 + TIME_WORD_WIDTH, 88, 2, &gray);
-  draw_digits(app, game, 64 + TIME_WORD_WIDTH, seconds, 2, &green);
+  add_digits(app, 64 + TIME_WORD_WIDTH, 88, 2, &gray);
+  add_digits(app, 64 + TIME_WORD_WIDTH, seconds, 2, &green);
 }
 
 static void
-draw_current_count(app_data_t* app, game_t* game) {
+add_current_count(app_data_t* app, int move_count) {
   color_t   green = { 0, 255, 0, 255 };
   color_t   gray  = { 64, 64, 64, 255 };
   int       offset = 16 + COUNT_WORD_WIDTH + COUNT_OFFSET;
 
-  draw_digits(app, game, offset, 88888, 5, &gray);
-  draw_digits(app, game, offset, game->move_count, 5, &green);
+  add_digits(app, offset, 88888, 5, &gray);
+  add_digits(app, offset, move_count, 5, &green);
 }
 
+/**
+   Draws the hud.  Its quads are only rebuilt when the clock or the move
+   count shows something new; otherwise last frame's are drawn again.
+*/
 static void
 draw_game_hud(app_data_t* app, game_t* game) {
-  draw_hud_words(app);
+  int seconds = get_clock_seconds(game);
+
+  if(app->hud->count == 0 || seconds != app->hud_seconds ||
+     game->move_count != app->hud_move_count)
+  {
+    quad_run_clear(app->hud);
+
+    add_hud_words(app);
+    add_current_time(app, seconds);
+    add_current_count(app, game->move_count);
+
+    app->hud_seconds = seconds;
+    app->hud_move_count = game->move_count;
+  }
 
-  draw_current_time(app, game);
-  draw_current_count(app, game);
+  quad_run_render(app->hud);
 }
 
 void
 game_render(app_data_t* app, game_t* game) {
   draw_game_board(game);
   draw_game_hud(app, game);
+
+  game->needs_render = false;
+  game->rendered_seconds = get_clock_seconds(game);
+  game->rendered_move_count = game->move_count;
+}
+
+bool
+game_needs_render(game_t* game) {
+  return game->needs_render ||
+    game->play_state == PLAY_STATE_MOVING_TILE ||
+    game->rendered_seconds != get_clock_seconds(game) ||
+    game->rendered_move_count != game->move_count;
 }
 
 //==============================================================================
@@ -328,98 +458,155 @@ check_for_win(game_t* game) {
   return is_win;
 }
 
-void
+/**
+   Finds the empty slot on the board.
+*/
+static point_t
+find_empty_tile(game_t* game) {
+  point_t empty = { 0, 0 };
+
+  for(int x = 0; x < game->skill; x++) {
+    for(int y = 0; y < game->skill; y++) {
+      if(is_tile_empty(game, x, y)) {
+        empty.x = x;
+        empty.y = y;
+      }
+    }
+  }
+
+  return empty;
+}
+
+/**
+   Starts the tiles from a cell up to the empty slot sliding, if they line
+   up.
+
+   @return
+     True if tiles started sliding.
+*/
+static bool
+start_slide(game_t* game, int tile_x, int tile_y) {
+  point_t empty = find_empty_tile(game);
+  int     count = abs(empty.x - tile_x) + abs(empty.y - tile_y);
+
+  if((tile_x != empty.x && tile_y != empty.y) || count == 0) {
+    return false;
+  }
+
+  game->slide_direction.x = (empty.x > tile_x) - (empty.x < tile_x);
+  game->slide_direction.y = (empty.y > tile_y) - (empty.y < tile_y);
+  game->slide_count = count;
+  game->slide = 0.0f;
+  game->previous_slide = 0.0f;
+
+  // Everything from the clicked tile up to the empty slot moves.
+  for(int i = 0; i < count; i++) {
+    get_game_tile(game, tile_x + game->slide_direction.x * i,
+                  tile_y + game->slide_direction.y * i)->sliding = true;
+  }
+
+  game->play_state = PLAY_STATE_MOVING_TILE;
+  return true;
+}
+
+bool
 game_on_click(game_t* game, int x, int y) {
+  bool moved = false;
+
   if(game->play_state == PLAY_STATE_WAIT_FOR_INPUT) {
     // Translate the x, y to a tile x, y
-    int tile_x = (x / (SCREEN_WIDTH * 1.0f)) * game->skill;
-    int tile_y = ((y - HEIGHT_OFFSET) / 
-                  (SCREEN_HEIGHT - HEIGHT_OFFSET * 1.0f)) * game->skill;
-
-    // We must find the adjacent NULL sprite tile.
-    point_t adj[4] = {
-      { tile_x - 1, tile_y },
-      { tile_x,     tile_y - 1 },
-      { tile_x + 1, tile_y },
-      { tile_x,     tile_y + 1 }
-    };
+    int tile_x = ((x - game->viewport.x) / 
+                  (game->viewport.width * 1.0f)) * game->skill;
+    int tile_y = ((y - game->viewport.y) / 
+                  (game->viewport.height * 1.0f)) * game->skill;
+
+    if(tile_x >= 0 && tile_x < game->skill && 
+       tile_y >= 0 && tile_y < game->skill)
+    {
+      moved = start_slide(game, tile_x, tile_y);
+    }
+  }
 
-    for(int i = 0; i < 4; i++) {
-      point_t test = adj[i];
+  return moved;
+}
 
-      // Ignore points that are out of bounds.
-      if(test.x >= 0 && test.x < game->skill && 
-         test.y >= 0 && test.y < game->skill) 
-      {
-        if(is_tile_empty(game, test.x, test.y)) {
-          game_tile_t* current_tile = get_game_tile(game, tile_x, tile_y);
-          
-          current_tile->velocity.x = (test.x - tile_x) * SLIDE_VELOCITY;
-          current_tile->velocity.y = (test.y - tile_y) * SLIDE_VELOCITY;
+bool
+game_move_random(game_t* game) {
+  bool moved = false;
 
-          game->play_state = PLAY_STATE_MOVING_TILE;
-        }
-      }
+  if(game->play_state == PLAY_STATE_WAIT_FOR_INPUT) {
+    point_t empty = find_empty_tile(game);
+    // Any other cell in the empty slot's row or column.
+    int     offset = game_rand_int(game, 1, game->skill);
+
+    if(game_rand_int(game, 0, 2) == 0) {
+      moved = start_slide(game, (empty.x + offset) % game->skill, empty.y);
+    } else {
+      moved = start_slide(game, empty.x, (empty.y + offset) % game->skill);
     }
   }
+
+  return moved;
 }
 
 /**
-   Resets the properties of a moving tile.
+   Moves the sliding tiles into their new cells all at once and stops them.
 */
 static void
-reset_moving_tile_to_stationary(game_tile_t* tile) {
+finish_slide(game_t* game) {
+  point_t empty = find_empty_tile(game);
+  point_t direction = game->slide_direction;
   point_t reset = { 0, 0 };
 
-  tile->velocity = reset;
-  tile->pixel_offset = reset;
+  // Each tile steps into the slot the one ahead of it just left.
+  for(int i = 1; i <= game->slide_count; i++) {
+    game_tile_t* tile = get_game_tile(game, empty.x - direction.x * i,
+                                      empty.y - direction.y * i);
+
+    tile->sliding = false;
+    swap_tiles(game, 
+               empty.x - direction.x * (i - 1),
+               empty.y - direction.y * (i - 1),
+               empty.x - direction.x * i,
+               empty.y - direction.y * i);
+  }
+
+  game->move_count += game->slide_count;
+  game->slide_direction = reset;
+  game->slide_count = 0;
+  game->slide = 0.0f;
+  game->previous_slide = 0.0f;
 }
 
 /**
-   Performs the tile's movement calculations.
+   Gets how far tiles sliding in a direction travel, one tile's width or
+   height on screen.
+*/
+static float
+slide_distance(game_t* game, point_t direction) {
+  if(direction.x != 0) {
+    return game->board_sheet->sprite_width * game->scale_width;
+  } else {
+    return game->board_sheet->sprite_height * game->scale_height;
+  }
+}
 
-   @param game
-     Current game instance.
-   @param tile
-     Moving tile.  The tile's velocity should not be zero.
+/**
+   Moves the game on by one fixed step.
 */
 static void
-move_tile_calculation(game_t* game, game_tile_t* tile) {
-  bool tile_adjusted = false;
-  tile->pixel_offset.x += tile->velocity.x;
-  tile->pixel_offset.y += tile->velocity.y;
-  
-  // Check to see if the tile has reached it's destination.
-  if(abs(tile->pixel_offset.x) >= 
-     (tile->sprite->area.width * game->scale_width))
-  {
-    int xmod = tile->velocity.x / abs(tile->velocity.x);
-    
-    swap_tiles(game, 
-               tile->position.x + xmod,
-               tile->position.y,
-               tile->position.x,
-               tile->position.y);
-    tile_adjusted = true;
-  } else if(abs(tile->pixel_offset.y) >= 
-            (tile->sprite->area.height * game->scale_height)) 
-  {
-    int ymod = tile->velocity.y / abs(tile->velocity.y);
-    
-    swap_tiles(game, 
-               tile->position.x,
-               tile->position.y + ymod,
-               tile->position.x,
-               tile->position.y);
-    tile_adjusted = true;
-  }
+game_step(game_t* game) {
+  if(game->slide_count > 0) {
+    game->previous_slide = game->slide;
+    game->slide += SLIDE_VELOCITY * game->step_length;
 
-  if(tile_adjusted) {
-    reset_moving_tile_to_stationary(tile);
-    game->move_count++;
+    // Check to see if the tiles have reached their destination.
+    if(game->slide >= slide_distance(game, game->slide_direction)) {
+      finish_slide(game);
 
-    if(!check_for_win(game)) {
-      game->play_state = PLAY_STATE_WAIT_FOR_INPUT;
+      if(!check_for_win(game)) {
+        game->play_state = PLAY_STATE_WAIT_FOR_INPUT;
+      }
     }
   }
 }
@@ -428,15 +615,248 @@ void
 game_update(game_t* game, double delta) {
   if(game->play_state != PLAY_STATE_GAME_FINISHED) {
     game->play_time += delta;
-    
-    for(int x = 0; x < game->skill; x++) {
-      for(int y = 0; y < game->skill; y++) {
-        game_tile_t* tile = get_game_tile(game, x, y);
-        
-        if(tile->velocity.x != 0 || tile->velocity.y != 0) {
-          move_tile_calculation(game, tile);
-        }
+    game->step_accumulator += delta < MAX_UPDATE_DELTA ? 
+      delta : MAX_UPDATE_DELTA;
+
+    while(game->step_accumulator >= game->step_length) {
+      game_step(game);
+      game->step_accumulator -= game->step_length;
+    }
+  }
+}
+
+//==============================================================================
+// Save/Restore
+//==============================================================================
+
+static void
+put_u32(uint8_t* bytes, uint32_t value) {
+  bytes[0] = value;
+  bytes[1] = value >> 8;
+  bytes[2] = value >> 16;
+  bytes[3] = value >> 24;
+}
+
+static uint32_t
+get_u32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+    ((uint32_t)bytes[3] << 24);
+}
+
+static void
+put_float(uint8_t* bytes, float value) {
+  uint32_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  put_u32(bytes, bits);
+}
+
+static float
+get_float(const uint8_t* bytes) {
+  uint32_t bits = get_u32(bytes);
+  float    value;
+
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static void
+put_u64(uint8_t* bytes, uint64_t value) {
+  put_u32(bytes, (uint32_t)value);
+  put_u32(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t
+get_u64(const uint8_t* bytes) {
+  return get_u32(bytes) | (uint64_t)get_u32(bytes + 4) << 32;
+}
+
+static void
+put_double(uint8_t* bytes, double value) {
+  uint64_t bits;
+
+  memcpy(&bits, &value, sizeof(bits));
+  put_u64(bytes, bits);
+}
+
+static double
+get_double(const uint8_t* bytes) {
+  uint64_t bits = get_u64(bytes);
+  double   value;
+
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void
+game_save(game_t* game, uint8_t* record) {
+  board_t board;
+  int     direction = 0;
+
+  board_init(&board, game->skill);
+
+  for(int x = 0; x < game->skill; x++) {
+    for(int y = 0; y < game->skill; y++) {
+      game_tile_t* tile = get_game_tile(game, x, y);
+
+      board_set(&board, x + y * game->skill,
+                tile->win_position.x + tile->win_position.y * game->skill);
+    }
+  }
+
+  // The tiles move towards the empty slot, the way a direction_t names.
+  if(game->slide_direction.y < 0) {
+    direction = DIRECTION_UP;
+  } else if(game->slide_direction.y > 0) {
+    direction = DIRECTION_DOWN;
+  } else if(game->slide_direction.x < 0) {
+    direction = DIRECTION_LEFT;
+  } else if(game->slide_direction.x > 0) {
+    direction = DIRECTION_RIGHT;
+  }
+
+  record[0] = 1;
+  record[1] = game->skill;
+  record[2] = game->play_state;
+  record[3] = direction | game->slide_count << 2;
+  put_u32(record + 4, game->move_count);
+  put_u32(record + 8, game->random);
+  put_double(record + 12, game->play_time - game->time_game_begin);
+  put_float(record + 20, game->slide);
+  put_float(record + 24, game->previous_slide);
+  put_float(record + 28, game->step_accumulator);
+
+  for(int i = 0; i < BOARD_WORDS; i++) {
+    put_u64(record + 32 + i * 8, board.words[i]);
+  }
+}
+
+bool
+game_restore(game_t* game, const uint8_t* record) {
+  static const point_t directions[] = {
+    [DIRECTION_UP]    = {  0, -1 },
+    [DIRECTION_DOWN]  = {  0,  1 },
+    [DIRECTION_LEFT]  = { -1,  0 },
+    [DIRECTION_RIGHT] = {  1,  0 }
+  };
+
+  board_t  board;
+  int      cells = game->skill * game->skill;
+  uint32_t seen = 0;
+  point_t  empty;
+  point_t  direction = directions[record[3] & 3];
+  int      slide_count = record[3] >> 2;
+  double   clock = get_double(record + 12);
+  float    slide = get_float(record + 20);
+  float    previous_slide = get_float(record + 24);
+  float    step_accumulator = get_float(record + 28);
+
+  if(record[0] != 1 || record[1] != game->skill ||
+     record[2] > PLAY_STATE_GAME_FINISHED || get_u32(record + 8) == 0)
+  {
+    return false;
+  }
+
+  board.size = game->skill;
+  for(int i = 0; i < BOARD_WORDS; i++) {
+    board.words[i] = get_u64(record + 32 + i * 8);
+  }
+
+  // The tiles have to be a permutation, which also finds the empty slot.
+  for(int i = 0; i < cells; i++) {
+    int tile = board_get(&board, i);
+
+    if(tile >= cells || (seen & 1u << tile)) {
+      return false;
+    }
+
+    seen |= 1u << tile;
+    if(tile == 0) {
+      board.blank = i;
+    }
+  }
+
+  // Half of all permutations can't come from shuffling a solved board.
+  if(!board_is_solvable(&board)) {
+    return false;
+  }
+
+  // A sliding run has to end at the empty slot and fit on the board.
+  empty.x = board.blank % game->skill;
+  empty.y = board.blank / game->skill;
+
+  if((slide_count > 0) != (record[2] == PLAY_STATE_MOVING_TILE) ||
+     empty.x - direction.x * slide_count < 0 ||
+     empty.x - direction.x * slide_count >= game->skill ||
+     empty.y - direction.y * slide_count < 0 ||
+     empty.y - direction.y * slide_count >= game->skill)
+  {
+    return false;
+  }
+
+  // Stepping leaves less than a step of time over, or at most the longest
+  // update for a record from a game stepping at another rate.  The checks
+  // are written negated so NaN fails them.
+  if(!isfinite(clock) ||
+     !(step_accumulator >= 0.0f &&
+       step_accumulator < fmax(game->step_length, MAX_UPDATE_DELTA)))
+  {
+    return false;
+  }
+
+  // Slides run from 0 up to a tile's length and are reset between runs.
+  if(slide_count > 0 ?
+     !(previous_slide >= 0.0f && previous_slide <= slide &&
+       slide < slide_distance(game, direction)) :
+     !(slide == 0.0f && previous_slide == 0.0f))
+  {
+    return false;
+  }
+
+  for(int x = 0; x < game->skill; x++) {
+    for(int y = 0; y < game->skill; y++) {
+      game_tile_t* tile = get_game_tile(game, x, y);
+      int          win = board_get(&board, x + y * game->skill);
+
+      tile->win_position.x = win % game->skill;
+      tile->win_position.y = win / game->skill;
+      tile->sliding = false;
+
+      if(win == 0) {
+        tile->sprite = NULL;
+      } else {
+        tile->sprite = sprite_sheet_get_sprite(game->board_sheet, 
+                                               tile->win_position.x,
+                                               tile->win_position.y);
       }
     }
   }
+
+  for(int i = 1; i <= slide_count; i++) {
+    get_game_tile(game, empty.x - direction.x * i,
+                  empty.y - direction.y * i)->sliding = true;
+  }
+
+  game->play_state = record[2];
+  game->slide_count = slide_count;
+  if(slide_count > 0) {
+    game->slide_direction = direction;
+  } else {
+    game->slide_direction.x = 0;
+    game->slide_direction.y = 0;
+  }
+
+  game->move_count = get_u32(record + 4);
+  game->random = get_u32(record + 8);
+  // Counting from zero gives back the same clock bytes when saved again.
+  game->time_game_begin = 0.0;
+  game->play_time = clock;
+  game->slide = slide;
+  game->previous_slide = previous_slide;
+  game->step_accumulator = step_accumulator;
+  game->input_time = 0.0;
+  game->input_shown = false;
+  game->needs_render = true;
+
+  return true;
 }
@@ -7,11 +7,20 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <stdint.h>
+
 #include "gfx.h"
+#include "atlas.h"
 
 extern const int SCREEN_WIDTH;
 extern const int SCREEN_HEIGHT;
 
+/** Number of times per second the game logic steps by default. */
+extern const int GAME_UPDATE_RATE;
+
+/** Bytes in a record written by game_save. */
+#define GAME_SNAPSHOT_SIZE 56
+
 /**
    Skill levels.  Each number represents the number of vertical and horizontal
    tiles the board will be cut into.  So for easy, the board will be 3x3.
@@ -51,8 +60,8 @@ typedef struct game_tile {
   point_t position;
   point_t win_position;
 
-  point_t velocity;
-  point_t pixel_offset;
+  /** Set while the tile is part of the run of tiles sliding. */
+  bool    sliding;
 
   sprite_t* sprite;
 } game_tile_t;
@@ -67,31 +76,89 @@ typedef struct game {
   /** Holds the sprite sheet used when drawing the board pieces. */
   sprite_sheet_t* board_sheet;
 
+  /** 
+      Draws the board pieces in one call.  Instance n is the tile that 
+      belongs at board index n + 1 (the empty slot has no instance).
+  */
+  instance_layer_t* board_layer;
+
   /** Holds the positions of the sprites on the board. */
   game_tile_t*    board;
 
+  /** 
+      Cell the sliding tiles move towards, relative to their own.  0, 0
+      when nothing is sliding.
+  */
+  point_t         slide_direction;
+  /** Number of tiles sliding, from the empty slot back to the one clicked. */
+  int             slide_count;
+  /** Pixels the sliding tiles have moved as of the latest update step. */
+  float           slide;
+  /** Pixels they had moved as of the step before, to draw in between. */
+  float           previous_slide;
+
   /** Used when rendering the sprites to the screen to scale them properly. */
   float           scale_width;
   /** Used when rendering the sprites to the screen to scale them properly. */
   float           scale_height;
 
-  double          last_update_time;
+  /** 
+      Screen area the board is drawn in and takes clicks from.  Slides are
+      worked out at full size and scaled down to it.
+  */
+  rect_t          viewport;
+
   double          time_game_begin;
 
+  /** Seconds of game time each update step simulates. */
+  double          step_length;
+  /** Time passed to game_update that hasn't been stepped through yet. */
+  double          step_accumulator;
+
   /** Holds the amount of time that has progressed since the game started. */
   double          play_time;
 
   int             move_count;
+
+  /** 
+      State of the game's own random number generator, used for shuffling
+      and random moves.  Never zero.
+  */
+  uint32_t        random;
+
+  /** Set when something changed that the next frame needs to show. */
+  bool            needs_render;
+  /** Clock value shown by the last rendered frame. */
+  int             rendered_seconds;
+  /** Move count shown by the last rendered frame. */
+  int             rendered_move_count;
+
+  /** 
+      When the click that started the current slide happened, by
+      profile_now, or 0 if there's no click waiting to be seen.
+  */
+  double          input_time;
+  /** Set once a rendered frame has drawn the clicked tiles moved. */
+  bool            input_shown;
 } game_t;
 
 /**
    Holds common application data used through the app.
 */
 typedef struct app_data {
+  /** Holds the hud and font images so they draw from one texture. */
+  atlas_t*        ui_atlas;
+
   sprite_sheet_t* digits;
   
-  texture_t*      hud_words;
+  sprite_t        hud_words;
   font_t*         menu_font;
+
+  /** Hud quads, rebuilt only when the values it shows change. */
+  quad_run_t*     hud;
+  /** Clock and move count the hud quads show. */
+  int             hud_seconds;
+  int             hud_move_count;
 } app_data_t;
 
 /**
@@ -113,7 +180,31 @@ void
 game_render(app_data_t* app, game_t* game);
 
 /**
-   Called when a mouse click occurs.
+   Moves the board to another part of the screen.  The hud isn't drawn when
+   the board doesn't fill the tile area.
+*/
+void
+game_set_viewport(game_t* game, rect_t* viewport);
+
+/**
+   Adds the board's tiles to a quad run instead of drawing them, so many
+   boards sharing a texture can be drawn together.  The run has to use the
+   texture the game was made with.
+*/
+void
+game_add_board_quads(game_t* game, quad_run_t* run);
+
+/**
+   Checks if anything visible has changed since the last game_render.  This
+   is always true while a tile is sliding.
+*/
+bool
+game_needs_render(game_t* game);
+
+/**
+   Called when a mouse click occurs.  Clicking a tile in the same row or
+   column as the empty slot slides it and every tile between it and the slot
+   along one cell, as one move of the whole run.
 
    @param game
      The currently running game.
@@ -121,12 +212,28 @@ game_render(app_data_t* app, game_t* game);
      The pixel coordinate where the mouse was clicked.
    @param y
      The pixel coordinate where the mouse was clicked.
+   @return
+     True if the click started tiles sliding.
 */
-void
+bool
 game_on_click(game_t* game, int x, int y);
 
 /**
-   Needs to be called to update the current game state/animation.
+   Slides a random run of tiles, as a player clicking at random would.
+   Used to keep spectated boards moving.  Draws from the game's own random
+   number generator, so different games can be moved on different threads.
+
+   @return
+     True if tiles started sliding.
+*/
+bool
+game_move_random(game_t* game);
+
+/**
+   Needs to be called to update the current game state/animation.  The game
+   logic runs in fixed steps of step_length seconds however delta is sliced
+   up, and game_render draws sliding tiles between the last two steps, so
+   motion is the same at any frame rate.
 
    @param delta
      Amount of time between this call and the last call.
@@ -134,4 +241,45 @@ game_on_click(game_t* game, int x, int y);
 void
 game_update(game_t* game, double delta);
 
+/**
+   Writes the state of a game to a fixed size record: the board, move count,
+   play time, random number generator and any slide in progress.  All values
+   are little-endian and the record holds no pointers, so it can be stored
+   or sent to another process as is.
+
+   Layout:
+
+     byte 0      record version (1)
+     byte 1      skill
+     byte 2      play state
+     byte 3      sliding run: direction_t in bits 0-1, tile count in bits 2-4
+     bytes 4-7   move count
+     bytes 8-11  random number generator state
+     bytes 12-19 seconds on the clock, as a double
+     bytes 20-23 slide distance, as a float
+     bytes 24-27 slide distance the step before, as a float
+     bytes 28-31 time not yet stepped through, as a float
+     bytes 32-55 the tiles, packed as in board_t (board.h)
+
+   @param record
+     Receives GAME_SNAPSHOT_SIZE bytes.
+*/
+void
+game_save(game_t* game, uint8_t* record);
+
+/**
+   Puts a game back in the state saved to a record.  The sprites are found
+   again from where each tile sits.
+
+   @param game
+     A game started with the same skill as the saved one.
+   @return
+     False if the record isn't a valid game of this skill: tiles that
+     aren't a permutation reachable from the solved board, a slide that
+     doesn't fit on it, a clock that isn't finite, or a slide or step time
+     that is NaN or out of range.  The game is left unchanged.
+*/
+bool
+game_restore(game_t* game, const uint8_t* record);
+
 #endif
@@ -2,49 +2,295 @@
 
 #include <GL/glfw.h>
 #include "soil/SOIL.h"
+#include "soil/image_helper.h"
+#include "soil/stb_image_aug.h"
 
 #include "util.h"
 #include "gfx.h"
+#include "gfx_backend.h"
+#include "jobs.h"
+#include "profile.h"
+#include "trace.h"
 
 const color_t COLOR_WHITE = { 255, 255, 255, 255 };
 const color_t COLOR_BLACK = { 0, 0, 0, 255 };
 
+/** Marks a shadowed opengl state value as unknown. */
+#define GL_STATE_UNKNOWN -1
+
+/** What requested textures show until they're uploaded. */
+static const unsigned char PLACEHOLDER_PIXEL[4] = { 96, 96, 96, 255 };
+
+/**
+   A texture being loaded by texture_request.  The decode job fills in the
+   pixels and the upload continuation frees it.
+*/
+typedef struct texture_load {
+  /** 
+      Texture to upload into, or NULL if it was deleted first.  Only the
+      main thread touches it.
+  */
+  texture_t*     texture;
+  char*          filename;
+
+  /** Pixels to upload, or NULL if the image couldn't be decoded. */
+  unsigned char* pixels;
+  /** Upload size, bigger than the texture's if stretched to a power of two. */
+  int            width;
+  int            height;
+  /** True if pixels came from new_array rather than SOIL. */
+  bool           stretched;
+  /** 
+      Why decoding failed, taken on the decoding thread since SOIL keeps
+      its last result per thread.
+  */
+  const char*    error;
+} texture_load_t;
+
 static struct {
   bool inited;
   int  screen_width;
   int  screen_height;
 
   texture_t* tex_list_head;
+
+  /** Renderer everything is drawn with. */
+  const gfx_backend_t* backend;
+
+  /** 1x1 texture requested textures draw with until they're uploaded. */
+  GLuint      placeholder_id;
+  /** Requested textures waiting to be uploaded. */
+  int         pending_textures;
+  /** Decode jobs still running. */
+  job_group_t texture_jobs;
+
+  /** Counters for the frame being drawn. */
+  gfx_stats_t frame_stats;
+  /** Counters for the last completed frame. */
+  gfx_stats_t last_frame_stats;
+
+  /** Frame timing, used to compare renderers. */
+  unsigned long frame_count;
+  double        first_frame_time;
+  double        last_frame_time;
+  /** 
+      When a headless renderer started, so its clock counts from zero like
+      glfw's does.
+  */
+  double        headless_start_time;
+
+  /** 
+      Shadow copy of the opengl state set by the renderers, used to skip calls
+      that would not change anything.
+  */
+  struct {
+    GLint texture;
+    GLint texture_2d;
+    GLint blend;
+    GLint blend_func;
+  } gl;
 } gfx_context = {
   false,
   0,
   0,
-  NULL
+  NULL,
+  &gfx_backend_legacy
 };
 
+/**
+   Quads waiting to be drawn.  Every quad in the batch shares the same
+   texture (0 for untextured quads), so a flush is a single draw call.
+*/
+static struct {
+  gfx_vertex_t vertices[GFX_BATCH_MAX_QUADS * 4];
+  int          quad_count;
+  GLuint       texture;
+} batch;
+
+//==============================================================================
+// State cache
+//==============================================================================
+
+void
+gfx_state_invalidate(void) {
+  gfx_context.gl.texture = GL_STATE_UNKNOWN;
+  gfx_context.gl.texture_2d = GL_STATE_UNKNOWN;
+  gfx_context.gl.blend = GL_STATE_UNKNOWN;
+  gfx_context.gl.blend_func = GL_STATE_UNKNOWN;
+}
+
+/**
+   Records whether a state call was needed and returns that.
+*/
+static bool
+state_changes(GLint* shadow, GLint value) {
+  bool changes = *shadow != value;
+
+  if(changes) {
+    *shadow = value;
+    gfx_context.frame_stats.state_changes++;
+  } else {
+    gfx_context.frame_stats.state_changes_filtered++;
+  }
+
+  return changes;
+}
+
+void
+gfx_state_bind_texture(GLuint id) {
+  if(state_changes(&gfx_context.gl.texture, (GLint)id)) {
+    glBindTexture(GL_TEXTURE_2D, id);
+  }
+}
+
+void
+gfx_state_set_enabled(GLenum capability, bool enabled) {
+  GLint* shadow = capability == GL_BLEND ? 
+    &gfx_context.gl.blend : &gfx_context.gl.texture_2d;
+
+  if(state_changes(shadow, enabled)) {
+    if(enabled) {
+      glEnable(capability);
+    } else {
+      glDisable(capability);
+    }
+  }
+}
+
+void
+gfx_state_blend_func(GLenum src, GLenum dst) {
+  // Blend factors are 16-bit enums so both fit in one shadow value.
+  GLint packed = (GLint)((src << 16) | dst);
+
+  if(state_changes(&gfx_context.gl.blend_func, packed)) {
+    glBlendFunc(src, dst);
+  }
+}
+
+//==============================================================================
+// Opengl helpers
+//==============================================================================
+
+void
+gfx_gl_clear(color_t* color) {
+  glClearColor(color->red / 255.0f, color->green / 255.0f,
+               color->blue / 255.0f, color->alpha / 255.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void
+gfx_gl_texture_delete(GLuint id) {
+  // Deleting the bound texture reverts the binding to 0.
+  if(gfx_context.gl.texture == (GLint)id) {
+    gfx_context.gl.texture = 0;
+  }
+
+  glDeleteTextures(1, &id);
+}
+
+void
+gfx_gl_read_frame(unsigned char* pixels, int width, int height) {
+  int row_size = width * 4;
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  // Opengl reads bottom row first.
+  for(int top = 0, bottom = height - 1; top < bottom; top++, bottom--) {
+    unsigned char* a = pixels + top * row_size;
+    unsigned char* b = pixels + bottom * row_size;
+
+    for(int i = 0; i < row_size; i++) {
+      unsigned char temp = a[i];
+      a[i] = b[i];
+      b[i] = temp;
+    }
+  }
+}
+
+//==============================================================================
+// Setup
+//==============================================================================
+
+/**
+   Opens the window for a renderer and gets the renderer running on it.  The
+   window is closed again if the renderer can't run.
+*/
+static bool
+open_window(const gfx_backend_t* backend, int width, int height) {
+  bool result;
+
+  backend->window_hints();
+  glfwOpenWindowHint(GLFW_WINDOW_NO_RESIZE, GL_TRUE);
+  result = glfwOpenWindow(width, height, 8, 8, 8, 8, 8, 8, GLFW_WINDOW)
+    == GL_TRUE;
+
+  if(result) {
+    gfx_state_invalidate();
+    result = backend->init(width, height);
+
+    if(!result) {
+      glfwCloseWindow();
+    }
+  }
+
+  if(result) {
+    logmsg("Using the %s renderer.", backend->name);
+  } else {
+    logmsg("Unable to start the %s renderer.", backend->name);
+  }
+
+  return result;
+}
+
 bool
-gfx_init(const char* title, int width, int height) {
+gfx_init(const char* title, int width, int height, gfx_renderer_t renderer) {
   bool result = true;
 
   if(!gfx_context.inited) {
-    if(!glfwInit()) {
+    gfx_context.backend = &gfx_backend_legacy;
+    if(renderer == GFX_RENDERER_GL3) {
+      gfx_context.backend = &gfx_backend_gl3;
+    } else if(renderer == GFX_RENDERER_SOFTWARE) {
+      gfx_context.backend = &gfx_backend_software;
+    }
+
+    if(gfx_context.backend->headless) {
+      gfx_context.headless_start_time = profile_now();
+      result = gfx_context.backend->init(width, height);
+
+      if(result) {
+        logmsg("Using the %s renderer.", gfx_context.backend->name);
+      } else {
+        logmsg("Unable to start the %s renderer.", gfx_context.backend->name);
+      }
+    } else if(!glfwInit()) {
       logmsg("Unable to initialize graphics systems.");
       result = false;
     } else {
-      glfwOpenWindowHint(GLFW_WINDOW_NO_RESIZE, GL_TRUE);
-      result = glfwOpenWindow(width, height, 8, 8, 8, 8, 8, 8, GLFW_WINDOW)
-        == GL_TRUE;
+      result = open_window(gfx_context.backend, width, height);
+
+      // Fall back to the fixed function renderer.
+      if(!result && gfx_context.backend != &gfx_backend_legacy) {
+        gfx_context.backend = &gfx_backend_legacy;
+        result = open_window(gfx_context.backend, width, height);
+      }
       
       if(result) {
         glfwSetWindowTitle(title);
 
-        gfx_context.inited = true;
-        gfx_context.screen_width = width;
-        gfx_context.screen_height = height;
+        // Pace frames to the display rather than drawing as fast as possible.
+        glfwSwapInterval(1);
       } else {
         glfwTerminate();
       }
     }
+
+    if(result) {
+      gfx_context.inited = true;
+      gfx_context.screen_width = width;
+      gfx_context.screen_height = height;
+    }
   }
 
   return result;
@@ -55,10 +301,21 @@ gfx_shutdown(void) {
   texture_t* list_tex;
 
   if(gfx_context.inited) {
-    glfwTerminate();
-    gfx_context.inited = false;
+    logmsg("Last frame: %u quads, %u draw calls, %u state changes, %u "
+           "redundant state changes skipped.",
+           gfx_context.last_frame_stats.quads,
+           gfx_context.last_frame_stats.draw_calls,
+           gfx_context.last_frame_stats.state_changes,
+           gfx_context.last_frame_stats.state_changes_filtered);
+
+    if(gfx_context.frame_count > 1) {
+      logmsg("%s renderer: %lu frames, %.3f ms average frame time.",
+             gfx_context.backend->name, gfx_context.frame_count,
+             (gfx_context.last_frame_time - gfx_context.first_frame_time) *
+             1000.0 / (gfx_context.frame_count - 1));
+    }
 
-    // Delete interned textures.
+    // Delete interned textures while the context is still around.
     list_tex = gfx_context.tex_list_head;
     while(list_tex != NULL) {
       texture_t* temp = list_tex;
@@ -66,70 +323,209 @@ gfx_shutdown(void) {
 
       texture_delete(temp);
     }
+    gfx_context.tex_list_head = NULL;
+
+    if(gfx_context.placeholder_id != 0) {
+      gfx_context.backend->texture_delete(gfx_context.placeholder_id);
+      gfx_context.placeholder_id = 0;
+    }
+
+    gfx_context.backend->shutdown();
+
+    if(!gfx_context.backend->headless) {
+      glfwTerminate();
+    }
+    gfx_context.inited = false;
   }
 }
 
-/*
-  More info and base source:
-  http://www.gamedev.net/page/resources/_/technical/opengl/rendering-efficient-2d-sprites-in-opengl-using-r2429
-*/
-void gfx_begin_2d(void) {
-  GLint viewport[4];
+double
+gfx_get_time(void) {
+  double time;
 
-  // Get a copy of the viewport
-  glGetIntegerv(GL_VIEWPORT, viewport);
-  
-  // Save a copy of the projection matrix so that we can restore it 
-  // when it's time to do 3D rendering again.
-  glMatrixMode(GL_PROJECTION);
-  glPushMatrix();
-  glLoadIdentity();
-  
-  // Set up the orthographic projection
-  glOrtho(viewport[0],  viewport[0] + viewport[2],
-          viewport[1] + viewport[3], viewport[1], 
-          -1, 1);
-  glMatrixMode(GL_MODELVIEW);
-  glPushMatrix();
-  glLoadIdentity();
-  
-  // Make sure depth testing and lighting are disabled for 2D rendering until
-  // we are finished rendering in 2D
-  glPushAttrib(GL_DEPTH_BUFFER_BIT | GL_LIGHTING_BIT);
-  glDisable(GL_DEPTH_TEST);
-  glDisable(GL_LIGHTING);
+  // Headless renderers have no glfw timer, so the profiler's monotonic
+  // clock stands in.  Processor time would leave out time spent waiting.
+  if(gfx_context.backend->headless) {
+    time = profile_now() - gfx_context.headless_start_time;
+  } else {
+    time = glfwGetTime();
+  }
+
+  return time;
+}
+
+void
+gfx_clear(color_t* color) {
+  gfx_flush();
+  gfx_context.backend->clear(color);
+}
+
+bool
+gfx_save_frame(const char* filename) {
+  int            width = gfx_context.screen_width;
+  int            height = gfx_context.screen_height;
+  unsigned char* pixels = new_array(unsigned char, width * height * 4);
+  bool           result;
+
+  gfx_flush();
+  gfx_context.backend->read_frame(pixels, width, height);
+
+  result = SOIL_save_image(filename, SOIL_SAVE_TYPE_BMP, width, height, 4,
+                           pixels) != 0;
+  if(result) {
+    logmsg("Saved the frame to %s.", filename);
+  } else {
+    logmsg("Unable to save the frame to %s.", filename);
+  }
+
+  delete(pixels);
+  return result;
+}
+
+void gfx_begin_2d(void) {
+  gfx_context.backend->begin_2d();
 }
 
 void gfx_end_2d(void) {
-  glPopAttrib();
-  glMatrixMode(GL_PROJECTION);
-  glPopMatrix();
-  glMatrixMode(GL_MODELVIEW);
-  glPopMatrix();
+  gfx_flush();
+  gfx_context.backend->end_2d();
+}
+
+//==============================================================================
+// Batching
+//==============================================================================
+
+void
+gfx_flush(void) {
+  if(batch.quad_count > 0) {
+    gfx_context.backend->draw_quads(batch.texture, batch.vertices, 
+                                    batch.quad_count);
+
+    gfx_context.frame_stats.draw_calls++;
+    gfx_context.frame_stats.quads += batch.quad_count;
+
+    batch.quad_count = 0;
+  }
+}
+
+void
+gfx_swap_buffers(void) {
+  gfx_flush();
+  if(!gfx_context.backend->headless) {
+    glfwSwapBuffers();
+  }
+
+  gfx_context.last_frame_time = gfx_get_time();
+  if(gfx_context.frame_count++ == 0) {
+    gfx_context.first_frame_time = gfx_context.last_frame_time;
+  }
+
+  gfx_context.last_frame_stats = gfx_context.frame_stats;
+  memset(&gfx_context.frame_stats, 0, sizeof(gfx_stats_t));
+}
+
+void
+gfx_get_frame_stats(gfx_stats_t* stats) {
+  *stats = gfx_context.last_frame_stats;
+}
+
+static void
+batch_set_vertex(gfx_vertex_t* vertex, GLfloat x, GLfloat y,
+                 GLfloat u, GLfloat v, color_t* color)
+{
+  vertex->x = x;
+  vertex->y = y;
+  vertex->u = u;
+  vertex->v = v;
+  vertex->color = *color;
+}
+
+/**
+   Writes the four vertices of a quad, clockwise from the upper left-hand
+   corner.
+*/
+static void
+set_quad_vertices(gfx_vertex_t* vertex, rect_t* dest,
+                  GLfloat start_u, GLfloat start_v, GLfloat end_u,
+                  GLfloat end_v, color_t* color)
+{
+  batch_set_vertex(vertex++, dest->x, dest->y, start_u, start_v, color);
+  batch_set_vertex(vertex++, dest->x + dest->width, dest->y, 
+                   end_u, start_v, color);
+  batch_set_vertex(vertex++, dest->x + dest->width, dest->y + dest->height,
+                   end_u, end_v, color);
+  batch_set_vertex(vertex, dest->x, dest->y + dest->height, 
+                   start_u, end_v, color);
+}
+
+/**
+   Queues a quad in the sprite batch, flushing first if the texture changes
+   or the batch is full.
+
+   @param texture
+     Opengl texture id or 0 for an untextured quad.
+*/
+static void
+batch_add_quad(GLuint texture, rect_t* dest, 
+               GLfloat start_u, GLfloat start_v, GLfloat end_u, GLfloat end_v,
+               color_t* color)
+{
+  if(texture != batch.texture || batch.quad_count == GFX_BATCH_MAX_QUADS) {
+    gfx_flush();
+    batch.texture = texture;
+  }
+
+  set_quad_vertices(batch.vertices + batch.quad_count * 4, dest,
+                    start_u, start_v, end_u, end_v, color);
+  batch.quad_count++;
+}
+
+/**
+   Queues quads that already have their vertices worked out, flushing as
+   needed.
+*/
+static void
+batch_add_vertices(GLuint texture, const gfx_vertex_t* vertices,
+                   int quad_count)
+{
+  if(texture != batch.texture) {
+    gfx_flush();
+    batch.texture = texture;
+  }
+
+  while(quad_count > 0) {
+    int room = GFX_BATCH_MAX_QUADS - batch.quad_count;
+    int copied = min(room, quad_count);
+
+    memcpy(batch.vertices + batch.quad_count * 4, vertices,
+           copied * 4 * sizeof(gfx_vertex_t));
+    batch.quad_count += copied;
+
+    vertices += copied * 4;
+    quad_count -= copied;
+
+    if(quad_count > 0) {
+      gfx_flush();
+    }
+  }
 }
 
 //==============================================================================
 // Texture
 //==============================================================================
 
-texture_t* 
-texture_load(const char* filename, bool intern) {
+texture_t*
+texture_create(const unsigned char* pixels, int width, int height,
+               bool intern)
+{
   texture_t* texture = NULL;
   GLuint     id;
-  int        width, height;
 
-  id = SOIL_load_OGL_texture(filename,
-                             SOIL_LOAD_RGBA,
-                             SOIL_CREATE_NEW_ID,
-                             SOIL_FLAG_POWER_OF_TWO |
-                             SOIL_FLAG_TEXTURE_REPEATS |
-                             SOIL_FLAG_COMPRESS_TO_DXT,
-                             &width, &height);
+  trace_begin("texture_upload");
+  id = gfx_context.backend->texture_create(pixels, width, height);
+  trace_end("texture_upload");
 
-  if(0 == id) {
-    logmsg("Unable to load file %s into opengl texture.  Error: %s", filename,
-           SOIL_last_result());
-  } else {
+  if(0 != id) {
     texture = new(texture_t);
 
     texture->id = id;
@@ -140,18 +536,196 @@ texture_load(const char* filename, bool intern) {
       texture->gfx_tex_next = gfx_context.tex_list_head;
       gfx_context.tex_list_head = texture;
     }
+  }
+
+  return texture;
+}
+
+texture_t* 
+texture_load(const char* filename, bool intern) {
+  texture_t*     texture = NULL;
+  int            width, height, channels;
+  unsigned char* pixels;
+
+  trace_begin("texture_load");
+  trace_begin("image_decode");
+  pixels = SOIL_load_image(filename, &width, &height, &channels,
+                           SOIL_LOAD_RGBA);
+  trace_end("image_decode");
+
+  if(pixels != NULL) {
+    texture = texture_create(pixels, width, height, intern);
+    SOIL_free_image_data(pixels);
+  }
+  trace_end("texture_load");
 
+  if(texture == NULL) {
+    logmsg("Unable to load file %s into opengl texture.  Error: %s", filename,
+           SOIL_last_result());
+  } else {
     logmsg("Loaded texture %s into id %u.", filename, texture->id);
   }
   
   return texture;
 }
 
+static void upload_texture(void* data);
+
+static int
+power_of_two_above(int value) {
+  int result = 1;
+
+  while(result < value) {
+    result *= 2;
+  }
+
+  return result;
+}
+
+/**
+   Decodes a requested texture on a job thread, then hands it to the main
+   thread to upload.
+*/
+static void
+decode_texture(void* data) {
+  texture_load_t* load = data;
+  int             channels;
+
+  trace_begin("texture_load");
+  trace_begin("image_decode");
+  load->pixels = SOIL_load_image(load->filename, &load->width,
+                                 &load->height, &channels, SOIL_LOAD_RGBA);
+  trace_end("image_decode");
+
+  if(load->pixels == NULL) {
+    load->error = SOIL_last_result();
+  } else if(gfx_context.backend->power_of_two) {
+    int width = power_of_two_above(load->width);
+    int height = power_of_two_above(load->height);
+
+    // Done here the renderer finds nothing left to stretch.
+    if(width != load->width || height != load->height) {
+      unsigned char* stretched = new_array(unsigned char, width * height * 4);
+
+      trace_begin("image_stretch");
+      up_scale_image(load->pixels, load->width, load->height, 4, stretched,
+                     width, height);
+      trace_end("image_stretch");
+
+      SOIL_free_image_data(load->pixels);
+      load->pixels = stretched;
+      load->width = width;
+      load->height = height;
+      load->stretched = true;
+    }
+  }
+  trace_end("texture_load");
+
+  jobs_run_on_main(upload_texture, load);
+}
+
+/**
+   Uploads a decoded texture in place of its placeholder.  Loads whose
+   texture was deleted, or that finish after gfx_shutdown, are dropped.
+*/
+static void
+upload_texture(void* data) {
+  texture_load_t* load = data;
+  texture_t*      texture = load->texture;
+
+  if(texture != NULL && load->pixels == NULL) {
+    logmsg("Unable to load file %s into opengl texture.  Error: %s",
+           load->filename, load->error);
+  } else if(texture != NULL && gfx_context.inited) {
+    GLuint id;
+
+    trace_begin("texture_upload");
+    id = gfx_context.backend->texture_create(load->pixels, load->width,
+                                             load->height);
+    trace_end("texture_upload");
+
+    if(id == 0) {
+      logmsg("Unable to create a texture for %s.", load->filename);
+    } else {
+      texture->id = id;
+      logmsg("Loaded texture %s into id %u.", load->filename, id);
+    }
+  }
+
+  if(texture != NULL) {
+    texture->load = NULL;
+  }
+
+  if(load->stretched) {
+    delete(load->pixels);
+  } else if(load->pixels != NULL) {
+    SOIL_free_image_data(load->pixels);
+  }
+
+  gfx_context.pending_textures--;
+  delete(load->filename);
+  delete(load);
+}
+
+texture_t*
+texture_request(const char* filename, bool intern) {
+  texture_t*      texture;
+  texture_load_t* load;
+  int             width, height, channels;
+
+  if(!stbi_info(filename, &width, &height, &channels)) {
+    return texture_load(filename, intern);
+  }
+
+  if(gfx_context.placeholder_id == 0) {
+    gfx_context.placeholder_id =
+      gfx_context.backend->texture_create(PLACEHOLDER_PIXEL, 1, 1);
+  }
+
+  load = new(texture_load_t);
+  load->filename = new_array(char, strlen(filename) + 1);
+  strcpy(load->filename, filename);
+
+  texture = new(texture_t);
+  texture->id = gfx_context.placeholder_id;
+  texture->width = width;
+  texture->height = height;
+  texture->load = load;
+  load->texture = texture;
+
+  if(intern) {
+    texture->gfx_tex_next = gfx_context.tex_list_head;
+    gfx_context.tex_list_head = texture;
+  }
+
+  gfx_context.pending_textures++;
+  jobs_run(&gfx_context.texture_jobs, decode_texture, load);
+
+  return texture;
+}
+
+int
+texture_pending_count(void) {
+  return gfx_context.pending_textures;
+}
+
+void
+texture_finish_loads(void) {
+  jobs_wait(&gfx_context.texture_jobs);
+  jobs_run_main(0);
+}
+
 void
 texture_delete(texture_t* texture) {
-  logmsg("Deleting texture %d", texture->id);
+  if(texture->load != NULL) {
+    // The upload sees the load was abandoned and frees it.
+    texture->load->texture = NULL;
+  } else if(texture->id != gfx_context.placeholder_id) {
+    // Failed loads keep the placeholder, which isn't theirs to delete.
+    logmsg("Deleting texture %d", texture->id);
+    gfx_context.backend->texture_delete(texture->id);
+  }
 
-  glDeleteTextures(1, &texture->id);
   delete(texture);
 }
 
@@ -169,34 +743,8 @@ draw_quad(texture_t* texture,
   end_x = (src_area->x + src_area->width) / (texture->width * 1.0f);
   end_y = (src_area->y + src_area->height) / (texture->height * 1.0f);
 
-  glBindTexture(GL_TEXTURE_2D, texture->id);
-
-  // Initialize GL
-  glEnable(GL_TEXTURE_2D);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glEnable(GL_BLEND);
- 
-  glBegin(GL_QUADS); 
-  {
-    glColor4ub(color->red, color->green, color->blue, color->alpha);
-    glTexCoord2f(start_x, start_y);
-    glVertex2i(dest_area->x, dest_area->y);
-
-    glTexCoord2f(end_x, start_y);
-    glVertex2i(dest_area->x + dest_area->width, dest_area->y);
-
-    glTexCoord2f(end_x, end_y);
-    glVertex2i(dest_area->x + dest_area->width, 
-               dest_area->y + dest_area->height);
-
-    glTexCoord2f(start_x, end_y);
-    glVertex2i(dest_area->x, dest_area->y + dest_area->height);
-  }
-  glEnd();
-
-  // Disable the texture
-  glDisable(GL_TEXTURE_2D);
-  glDisable(GL_BLEND);
+  batch_add_quad(texture->id, dest_area, start_x, start_y, end_x, end_y, 
+                 color);
 }
 
 void
@@ -239,32 +787,14 @@ gfx_blit(texture_t* texture,
 
 void
 gfx_draw_rect(rect_t* rect, color_t* color, bool filled) {
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glEnable(GL_BLEND);
-
   if(filled) {
-    glBegin(GL_QUADS);
+    batch_add_quad(0, rect, 0.0f, 0.0f, 0.0f, 0.0f, color);
   } else {
-    glBegin(GL_LINE_LOOP);
-  }
-
-  {
-    glColor4ub(color->red, color->green, color->blue, color->alpha);
-    glVertex2i(rect->x, rect->y);
-
-    glColor4ub(color->red, color->green, color->blue, color->alpha);
-    glVertex2i(rect->x + rect->width, rect->y);
-
-    glColor4ub(color->red, color->green, color->blue, color->alpha);
-    glVertex2i(rect->x + rect->width, rect->y + rect->height);
-
-    glColor4ub(color->red, color->green, color->blue, color->alpha);
-    glVertex2i(rect->x, rect->y + rect->height);
+    // Outlines can't share the quad batch.
+    gfx_flush();
+    gfx_context.backend->draw_outline(rect, color);
+    gfx_context.frame_stats.draw_calls++;
   }
-
-  glEnd();
-
-  glDisable(GL_BLEND);
 }
 
 //==============================================================================
@@ -273,23 +803,35 @@ gfx_draw_rect(rect_t* rect, color_t* color, bool filled) {
 
 sprite_sheet_t*
 sprite_sheet_new(texture_t* texture, int sprite_width, int sprite_height) {
+  rect_t area = { 0, 0, texture->width, texture->height };
+
+  return sprite_sheet_new_from_area(texture, &area, sprite_width,
+                                    sprite_height);
+}
+
+sprite_sheet_t*
+sprite_sheet_new_from_area(texture_t* texture, rect_t* area, int sprite_width,
+                           int sprite_height)
+{
   sprite_sheet_t* sheet;
 
   sheet = new(sprite_sheet_t);
-  sheet->sprites = new_array(sprite_t, sprite_width * sprite_height);
 
   sheet->sprite_width = sprite_width;
   sheet->sprite_height = sprite_height;
 
-  sheet->width = texture->width / sprite_width;
-  sheet->height = texture->height / sprite_height;
+  sheet->width = area->width / sprite_width;
+  sheet->height = area->height / sprite_height;
+
+  sheet->sprites = new_array(sprite_t, sheet->width * sheet->height);
 
   for(int x = 0; x < sheet->width; x++) {
     for(int y = 0; y < sheet->height; y++) {
-      sprite_t* sprite = sprite_sheet_get_sprite(sheet, x, y);
-      sprite->texture = texture;
-      rect_set(&sprite->area, x * sprite_width, y * sprite_height,
-               sprite_width, sprite_height);
+      rect_t sprite_area = { area->x + x * sprite_width,
+                             area->y + y * sprite_height,
+                             sprite_width, sprite_height };
+
+      sprite_set(sprite_sheet_get_sprite(sheet, x, y), texture, &sprite_area);
     }
   }
 
@@ -308,18 +850,229 @@ sprite_sheet_get_sprite(sprite_sheet_t* sheet, int x, int y) {
 }
 
 void
-sprite_render(sprite_t* sprite, rect_t* dest, color_t* color) {
-  gfx_blit(sprite->texture, &sprite->area, dest, color);
+sprite_set(sprite_t* sprite, texture_t* texture, rect_t* area) {
+  sprite->texture = texture;
+  sprite->area = *area;
+
+  sprite->start_u = area->x / (texture->width * 1.0f);
+  sprite->start_v = area->y / (texture->height * 1.0f);
+  sprite->end_u = (area->x + area->width) / (texture->width * 1.0f);
+  sprite->end_v = (area->y + area->height) / (texture->height * 1.0f);
+}
+
+/**
+   Fills in the size of a destination left zero the way gfx_blit does.
+*/
+static void
+sprite_dest(sprite_t* sprite, rect_t* dest_area, rect_t* dest) {
+  *dest = *dest_area;
+
+  if(dest->width <= 0) {
+    dest->width = sprite->area.width;
+  }
+
+  if(dest->height <= 0) {
+    dest->height = sprite->area.height;
+  }
+}
+
+void
+sprite_render(sprite_t* sprite, rect_t* dest_area, color_t* color) {
+  color_t white = COLOR_WHITE;
+  rect_t  dest;
+
+  sprite_dest(sprite, dest_area, &dest);
+  batch_add_quad(sprite->texture->id, &dest, sprite->start_u,
+                 sprite->start_v, sprite->end_u, sprite->end_v,
+                 color != NULL ? color : &white);
 }
 
 //==============================================================================
-// Sprites
+// Quad runs
+//==============================================================================
+
+quad_run_t*
+quad_run_new(texture_t* texture, int capacity) {
+  quad_run_t* run = new(quad_run_t);
+
+  run->texture = texture;
+  run->capacity = max(capacity, 1);
+  run->vertices = new_array(gfx_vertex_t, run->capacity * 4);
+
+  return run;
+}
+
+void
+quad_run_delete(quad_run_t* run) {
+  delete(run->vertices);
+  delete(run);
+}
+
+void
+quad_run_clear(quad_run_t* run) {
+  run->count = 0;
+}
+
+/**
+   Makes room for one more quad, growing the run if it's full.
+
+   @return
+     The first vertex of the new quad.
+*/
+static gfx_vertex_t*
+quad_run_next(quad_run_t* run) {
+  if(run->count == run->capacity) {
+    run->capacity *= 2;
+    run->vertices = realloc(run->vertices,
+                            run->capacity * 4 * sizeof(gfx_vertex_t));
+    if(run->vertices == NULL) {
+      logmsg("Unable to grow a quad run to %d quads.", run->capacity);
+      exit(1);
+    }
+  }
+
+  return run->vertices + run->count++ * 4;
+}
+
+void
+quad_run_add(quad_run_t* run, rect_t* src_area, rect_t* dest_area,
+             color_t* color)
+{
+  sprite_t sprite;
+
+  sprite_set(&sprite, run->texture, src_area);
+  quad_run_add_sprite(run, &sprite, dest_area, color);
+}
+
+void
+quad_run_add_sprite(quad_run_t* run, sprite_t* sprite, rect_t* dest_area,
+                    color_t* color)
+{
+  color_t white = COLOR_WHITE;
+  rect_t  dest;
+
+  sprite_dest(sprite, dest_area, &dest);
+  set_quad_vertices(quad_run_next(run), &dest, sprite->start_u,
+                    sprite->start_v, sprite->end_u, sprite->end_v,
+                    color != NULL ? color : &white);
+}
+
+void
+quad_run_render(quad_run_t* run) {
+  batch_add_vertices(run->texture->id, run->vertices, run->count);
+}
+
+//==============================================================================
+// Instance layers
+//==============================================================================
+
+/**
+   Grows the layer's dirty range to cover an instance.
+*/
+static void
+instance_layer_touch(instance_layer_t* layer, int index) {
+  if(layer->dirty_start == layer->dirty_end) {
+    layer->dirty_start = index;
+    layer->dirty_end = index + 1;
+  } else {
+    layer->dirty_start = min(layer->dirty_start, index);
+    layer->dirty_end = max(layer->dirty_end, index + 1);
+  }
+}
+
+instance_layer_t*
+instance_layer_new(texture_t* texture, int count, int width, int height) {
+  instance_layer_t* layer = new(instance_layer_t);
+
+  layer->texture = texture;
+  layer->width = width;
+  layer->height = height;
+  layer->count = count;
+  layer->instances = new_array(gfx_instance_t, count);
+
+  // Everything needs to go up on the first draw.
+  layer->dirty_start = 0;
+  layer->dirty_end = count;
+
+  return layer;
+}
+
+void
+instance_layer_delete(instance_layer_t* layer) {
+  if(gfx_context.backend->delete_instances != NULL) {
+    gfx_context.backend->delete_instances(layer);
+  }
+
+  delete(layer->instances);
+  delete(layer);
+}
+
+void
+instance_layer_set_source(instance_layer_t* layer, int index, rect_t* src) {
+  gfx_instance_t* instance = layer->instances + index;
+  texture_t*      texture = layer->texture;
+
+  instance->start_u = src->x / (texture->width * 1.0f);
+  instance->start_v = src->y / (texture->height * 1.0f);
+  instance->end_u = (src->x + src->width) / (texture->width * 1.0f);
+  instance->end_v = (src->y + src->height) / (texture->height * 1.0f);
+
+  instance_layer_touch(layer, index);
+}
+
+void
+instance_layer_move(instance_layer_t* layer, int index, int x, int y) {
+  gfx_instance_t* instance = layer->instances + index;
+
+  if(instance->x != x || instance->y != y) {
+    instance->x = x;
+    instance->y = y;
+
+    instance_layer_touch(layer, index);
+  }
+}
+
+void
+instance_layer_render(instance_layer_t* layer) {
+  color_t white = COLOR_WHITE;
+
+  if(gfx_context.backend->draw_instances != NULL) {
+    // Keep anything queued before the layer underneath it.
+    gfx_flush();
+    gfx_context.backend->draw_instances(layer);
+
+    gfx_context.frame_stats.draw_calls++;
+    gfx_context.frame_stats.quads += layer->count;
+  } else {
+    for(int i = 0; i < layer->count; i++) {
+      gfx_instance_t* instance = layer->instances + i;
+      rect_t          dest = { instance->x, instance->y, 
+                               layer->width, layer->height };
+
+      batch_add_quad(layer->texture->id, &dest, 
+                     instance->start_u, instance->start_v,
+                     instance->end_u, instance->end_v, &white);
+    }
+  }
+
+  layer->dirty_start = layer->dirty_end = 0;
+}
+
+//==============================================================================
+// Fonts
 //==============================================================================
 
 const int FONT_MAPPING_SIZE = 256;
 
 font_t*
 font_new(texture_t* texture, int width, int height) {
+  rect_t area = { 0, 0, texture->width, texture->height };
+
+  return font_new_from_area(texture, &area, width, height);
+}
+
+font_t*
+font_new_from_area(texture_t* texture, rect_t* area, int width, int height) {
   font_t* font;
 
   // In the future custom mapping may be specified
@@ -327,13 +1080,14 @@ font_new(texture_t* texture, int width, int height) {
   font->mappings = new_array(point_t, 256);
   font->mapping_count = FONT_MAPPING_SIZE;
 
-  font->sheet = sprite_sheet_new(texture, width, height);
+  font->sheet = sprite_sheet_new_from_area(texture, area, width, height);
+  font->strings = new_array(font_string_t, FONT_STRING_CACHE_SIZE);
 
-  // Set up the mappings
+  // Set up the mappings.  Glyphs run across the sheet a row at a time.
   for(int i = 0; i < font->mapping_count; i++) {
     point_t* p = font->mappings + i;
-    p->x = i % texture->width;
-    p->y = i / texture->width;
+    p->x = i % font->sheet->width;
+    p->y = i / font->sheet->width;
   }
 
   return font;
@@ -341,6 +1095,14 @@ font_new(texture_t* texture, int width, int height) {
 
 void
 font_delete(font_t* font) {
+  for(int i = 0; i < FONT_STRING_CACHE_SIZE; i++) {
+    if(font->strings[i].run != NULL) {
+      quad_run_delete(font->strings[i].run);
+      delete(font->strings[i].text);
+    }
+  }
+
+  delete(font->strings);
   sprite_sheet_delete(font->sheet);
   delete(font->mappings);
   delete(font);
@@ -357,11 +1119,93 @@ font_render_char(font_t* font, int x, int y, int character, color_t* color) {
   sprite_render(sprite, &dest, color);
 }
 
+/**
+   FNV-1a hash of a string, used to rule out most cached strings without
+   comparing them.
+*/
+static uint32_t
+hash_string(const char* str, size_t* length) {
+  uint32_t    hash = 2166136261u;
+  const char* c = str;
+
+  for(; *c != '\0'; c++) {
+    hash = (hash ^ (unsigned char)*c) * 16777619u;
+  }
+
+  *length = c - str;
+  return hash;
+}
+
+/**
+   Finds the cached string drawn with the same text, position and color,
+   or the least recently used entry to replace if there isn't one.
+*/
+static font_string_t*
+font_find_string(font_t* font, int x, int y, const char* str, uint32_t hash,
+                 color_t* color, bool* found)
+{
+  font_string_t* oldest = font->strings;
+
+  *found = false;
+
+  for(int i = 0; i < FONT_STRING_CACHE_SIZE && !*found; i++) {
+    font_string_t* entry = font->strings + i;
+
+    if(entry->run != NULL && entry->hash == hash && entry->x == x &&
+       entry->y == y && memcmp(&entry->color, color, sizeof(color_t)) == 0 &&
+       strcmp(entry->text, str) == 0)
+    {
+      oldest = entry;
+      *found = true;
+    } else if(entry->last_used < oldest->last_used) {
+      oldest = entry;
+    }
+  }
+
+  return oldest;
+}
+
 void
 font_render_string(font_t* font, int x, int y, char* str, color_t* color) {
-  size_t len = strlen(str);
+  color_t        true_color = COLOR_WHITE;
+  font_string_t* entry;
+  size_t         length;
+  uint32_t       hash = hash_string(str, &length);
+  bool           found;
+
+  if(color != NULL) {
+    true_color = *color;
+  }
+
+  entry = font_find_string(font, x, y, str, hash, &true_color, &found);
 
-  for(int i = 0; i < len; i++, x += font->sheet->sprite_width) {
-    font_render_char(font, x, y, str[i], color);
+  if(!found) {
+    int glyph_x = x;
+
+    if(entry->run == NULL) {
+      entry->run = quad_run_new(font->sheet->sprites->texture, length);
+    } else {
+      quad_run_clear(entry->run);
+      delete(entry->text);
+    }
+
+    entry->text = new_array(char, length + 1);
+    memcpy(entry->text, str, length + 1);
+    entry->hash = hash;
+    entry->x = x;
+    entry->y = y;
+    entry->color = true_color;
+
+    for(size_t i = 0; i < length; i++) {
+      point_t*  p = font->mappings + (unsigned char)str[i];
+      sprite_t* sprite = sprite_sheet_get_sprite(font->sheet, p->x, p->y);
+      rect_t    dest = { glyph_x, y, 0, 0 };
+
+      quad_run_add_sprite(entry->run, sprite, &dest, &true_color);
+      glyph_x += font->sheet->sprite_width;
+    }
   }
+
+  entry->last_used = ++font->string_uses;
+  quad_run_render(entry->run);
 }
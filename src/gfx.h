@@ -10,16 +10,61 @@
 
 #include <GL/glfw.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "geo.h"
 
+//==============================================================================
+// Color
+//==============================================================================
+
+/**
+   Models a 32-bit color.  Each value is modeled as a byte for simplicity.
+*/
+typedef struct color {
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+  uint8_t alpha;
+} color_t;
+
+// Useful constant colors
+extern const color_t COLOR_WHITE;
+extern const color_t COLOR_BLACK;
+
+//==============================================================================
+// Setup
+//==============================================================================
+
+/**
+   Renderers that can sit behind the graphics API.
+*/
+typedef enum gfx_renderer {
+  /** Fixed function opengl.  Runs everywhere. */
+  GFX_RENDERER_LEGACY,
+
+  /** Opengl 3.3 core profile with vertex buffers and shaders. */
+  GFX_RENDERER_GL3,
+
+  /**
+     Draws on the cpu into memory.  Needs no display or gpu and opens no
+     window, so nothing that goes through glfw (input, window state) works
+     with it.
+  */
+  GFX_RENDERER_SOFTWARE
+} gfx_renderer_t;
+
 /**
    Initializes the graphics system.
 
+   @param renderer
+     Renderer to draw with.  Falls back to GFX_RENDERER_LEGACY if the
+     requested opengl renderer can't be started.
    @return
      False on failure the intialize.  True on success.
 */
-bool gfx_init(const char* title, int width, int height);
+bool gfx_init(const char* title, int width, int height, 
+              gfx_renderer_t renderer);
 
 /**
    Shuts down the graphics system and cleans everything up.
@@ -36,23 +81,61 @@ void gfx_begin_2d(void);
 */
 void gfx_end_2d(void);
 
+/**
+   Gets the current time in seconds, for measuring intervals.
+*/
+double gfx_get_time(void);
+
+/**
+   Fills the whole screen with a color.
+*/
+void gfx_clear(color_t* color);
+
+/**
+   Saves everything drawn so far this frame to a BMP file.
+
+   @return
+     True if the file was written.
+*/
+bool gfx_save_frame(const char* filename);
+
 //==============================================================================
-// Color
+// Batching
 //==============================================================================
 
 /**
-   Models a 32-bit color.  Each value is modeled as a byte for simplicity.
+   Rendering counters, used to check how well drawing is being batched.
 */
-typedef struct color {
-  uint8_t red;
-  uint8_t green;
-  uint8_t blue;
-  uint8_t alpha;
-} color_t;
+typedef struct gfx_stats {
+  /** Number of quads drawn. */
+  unsigned int quads;
 
-// Useful constant colors
-extern const color_t COLOR_WHITE;
-extern const color_t COLOR_BLACK;
+  /** Number of opengl draw calls issued. */
+  unsigned int draw_calls;
+
+  /** Number of opengl state changes (binds, enables, blend funcs) issued. */
+  unsigned int state_changes;
+
+  /** Number of state changes skipped because they would change nothing. */
+  unsigned int state_changes_filtered;
+} gfx_stats_t;
+
+/**
+   Draws everything queued by gfx_blit, sprite_render and gfx_draw_rect.
+   Queued quads are drawn in one call per texture change, so this needs to
+   be called before reading back or presenting the frame.
+*/
+void gfx_flush(void);
+
+/**
+   Flushes any queued drawing and presents the frame.
+*/
+void gfx_swap_buffers(void);
+
+/**
+   Gets the counters for the last frame presented with gfx_swap_buffers.
+*/
+void gfx_get_frame_stats(gfx_stats_t* stats);
 
 //==============================================================================
 // Texture
@@ -71,10 +154,29 @@ typedef struct texture {
   /** Texture height in pixels */
   int    height;
 
+  /** 
+      Set while a requested texture is still loading, when id is the
+      placeholder's.  NULL once the pixels are uploaded.
+  */
+  struct texture_load* load;
+
   /** Used internally to list textures. */
   struct texture* gfx_tex_next;
 } texture_t;
 
+/**
+   Creates an opengl texture from pixels in memory.
+
+   @param pixels
+     RGBA pixels, 4 bytes each, starting with the top row.
+   @param intern
+     Interned images will be cleaned up on close of the application.
+   @return
+     A new texture or NULL if the texture could not be created.
+*/
+texture_t* texture_create(const unsigned char* pixels, int width, int height,
+                          bool intern);
+
 /**
    Loads an image from a file into an opengl texture.
 
@@ -87,6 +189,35 @@ typedef struct texture {
 */
 texture_t* texture_load(const char* filename, bool intern);
 
+/**
+   Starts loading an image into an opengl texture without waiting for it.
+   Only the image header is read before this returns, so the texture's size
+   is known straight away.  The image is decoded by a job and uploaded by a
+   continuation on the main thread (see jobs_run_main), and until then the
+   texture draws as a flat gray placeholder.
+
+   Images whose header can't be read up front, anything but JPEG and PNG,
+   are loaded as texture_load does.
+
+   @param filename
+     Filename of the texture.
+   @param intern
+     Interned images will be cleaned up on close of the application.
+   @return
+     A new texture or NULL if the file could not be loaded.
+*/
+texture_t* texture_request(const char* filename, bool intern);
+
+/**
+   Gets the number of requested textures not uploaded yet.
+*/
+int texture_pending_count(void);
+
+/**
+   Waits for every requested texture to be decoded and uploads them.
+*/
+void texture_finish_loads(void);
+
 /**
    Will clean up a texture in memory.
 */
@@ -125,6 +256,12 @@ gfx_draw_rect(rect_t* rect, color_t* color, bool filled);
 typedef struct sprite {
   texture_t* texture;
   rect_t     area;
+
+  /** The area in normalized texture coordinates, ready for drawing. */
+  GLfloat    start_u;
+  GLfloat    start_v;
+  GLfloat    end_u;
+  GLfloat    end_v;
 } sprite_t;
 
 typedef struct sprite_sheet {
@@ -145,6 +282,17 @@ typedef struct sprite_sheet {
 sprite_sheet_t*
 sprite_sheet_new(texture_t* texture, int sprite_width, int sprite_height);
 
+/**
+   Creates a new sprite sheet from part of a texture, such as one image in
+   an atlas.
+
+   @param area
+     Area of the texture the sheet covers, in pixels.
+*/
+sprite_sheet_t*
+sprite_sheet_new_from_area(texture_t* texture, rect_t* area, int sprite_width,
+                           int sprite_height);
+
 /**
    Cleans up a sprite sheet.
 */
@@ -161,15 +309,186 @@ sprite_t*
 sprite_sheet_get_sprite(sprite_sheet_t* sheet, int x, int y);
 
 /**
-   Draws a sprite to the screen.
+   Points a sprite at an area of a texture.  Sprites made any other way
+   than through a sprite sheet need to be set up with this.
+*/
+void
+sprite_set(sprite_t* sprite, texture_t* texture, rect_t* area);
+
+/**
+   Draws a sprite to the screen.  Takes the same defaults as gfx_blit.
 */
 void
 sprite_render(sprite_t* sprite, rect_t* dest, color_t* color);
 
+//==============================================================================
+// Quad runs
+//==============================================================================
+
+struct gfx_vertex;
+
+/**
+   A list of quads from one texture whose vertices are worked out once and
+   kept.  Rendering a run copies it straight into the sprite batch, so
+   things that rarely change (the hud, text) only pay for building their
+   quads when they do change.
+*/
+typedef struct quad_run {
+  texture_t*         texture;
+
+  /** Used internally to hold four vertices per quad. */
+  struct gfx_vertex* vertices;
+  int                count;
+  int                capacity;
+} quad_run_t;
+
+/**
+   Creates an empty quad run.
+
+   @param capacity
+     Number of quads to make room for.  The run grows past this if needed.
+*/
+quad_run_t*
+quad_run_new(texture_t* texture, int capacity);
+
+/**
+   Cleans up a quad run.
+*/
+void
+quad_run_delete(quad_run_t* run);
+
+/**
+   Removes every quad from the run.
+*/
+void
+quad_run_clear(quad_run_t* run);
+
+/**
+   Adds a quad to the run.  Takes the same arguments as gfx_blit, except
+   the source area is required.
+*/
+void
+quad_run_add(quad_run_t* run, rect_t* src_area, rect_t* dest_area,
+             color_t* color);
+
+/**
+   Adds a sprite from the run's texture to the run.
+*/
+void
+quad_run_add_sprite(quad_run_t* run, sprite_t* sprite, rect_t* dest_area,
+                    color_t* color);
+
+/**
+   Queues every quad in the run for drawing.
+*/
+void
+quad_run_render(quad_run_t* run);
+
+//==============================================================================
+// Instance layers
+//==============================================================================
+
+/**
+   Placement of one quad in an instance layer.
+*/
+typedef struct gfx_instance {
+  /** Upper left-hand corner of the destination. */
+  GLfloat x;
+  GLfloat y;
+
+  /** Normalized texture coordinates of the source area. */
+  GLfloat start_u;
+  GLfloat start_v;
+  GLfloat end_u;
+  GLfloat end_v;
+} gfx_instance_t;
+
+/**
+   A set of equally sized quads from one texture that is drawn in a single
+   call.  Only the instances that changed since the last draw are sent to
+   the renderer again.
+*/
+typedef struct instance_layer {
+  texture_t*      texture;
+
+  /** Size every instance is drawn at. */
+  int             width;
+  int             height;
+
+  gfx_instance_t* instances;
+  int             count;
+
+  /** Range of instances changed since the last draw. */
+  int             dirty_start;
+  int             dirty_end;
+
+  /** Used internally by renderers that draw instances natively. */
+  GLuint          vertex_array;
+  GLuint          buffer;
+} instance_layer_t;
+
+/**
+   Creates a new instance layer.
+
+   @param count
+     Number of instances.  All of them are drawn; they start out zero sized
+     at the origin until given a source.
+   @param width
+     Width every instance is drawn at.
+   @param height
+     Height every instance is drawn at.
+*/
+instance_layer_t*
+instance_layer_new(texture_t* texture, int count, int width, int height);
+
+/**
+   Cleans up an instance layer.
+*/
+void
+instance_layer_delete(instance_layer_t* layer);
+
+/**
+   Sets the area of the layer's texture an instance shows.
+*/
+void
+instance_layer_set_source(instance_layer_t* layer, int index, rect_t* src);
+
+/**
+   Moves an instance.  Nothing is sent to the renderer if the position is
+   unchanged.
+*/
+void
+instance_layer_move(instance_layer_t* layer, int index, int x, int y);
+
+/**
+   Draws every instance in the layer.
+*/
+void
+instance_layer_render(instance_layer_t* layer);
+
 //==============================================================================
 // Fonts
 //==============================================================================
 
+/** Number of recently drawn strings each font keeps the quads of. */
+#define FONT_STRING_CACHE_SIZE 16
+
+/**
+   Quads for a string drawn with a font, kept so drawing it again is a copy
+   into the sprite batch.
+*/
+typedef struct font_string {
+  char*         text;
+  uint32_t      hash;
+  int           x;
+  int           y;
+  color_t       color;
+
+  /** NULL while the entry is unused. */
+  quad_run_t*   run;
+  unsigned long last_used;
+} font_string_t;
+
 /**
    Models a set of characters that can be rendered to the screen.
 */
@@ -177,6 +496,10 @@ typedef struct font {
   sprite_sheet_t* sheet;
   point_t*        mappings;
   size_t          mapping_count;
+
+  /** Recently drawn strings.  Used internally by font_render_string. */
+  font_string_t*  strings;
+  unsigned long   string_uses;
 } font_t;
 
 /**
@@ -192,6 +515,15 @@ typedef struct font {
 font_t*
 font_new(texture_t* texture, int width, int height);
 
+/**
+   Creates a new font from part of a texture.
+
+   @param area
+     Area of the texture holding the font glyphs, in pixels.
+*/
+font_t*
+font_new_from_area(texture_t* texture, rect_t* area, int width, int height);
+
 /**
    Cleans up a newly allocated font.
 */
@@ -205,7 +537,9 @@ void
 font_render_char(font_t* font, int x, int y, int character, color_t* color);
 
 /**
-   Renders a string to the screen.
+   Renders a string to the screen.  The glyph quads of recently drawn
+   strings are cached by text, position and color, so drawing the same
+   string again costs a single copy into the sprite batch.
 */
 void
 font_render_string(font_t* font, int x, int y, char* str, color_t* color);
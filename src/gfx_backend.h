@@ -0,0 +1,136 @@
+/**
+   @file gfx_backend.h
+
+   Internal interface between the gfx module and the opengl renderers that
+   sit behind it.  Only the gfx source files should include this.
+*/
+#ifndef GFX_BACKEND_H
+#define GFX_BACKEND_H
+
+#include "gfx.h"
+
+/** Number of quads the sprite batch holds before it has to flush. */
+#define GFX_BATCH_MAX_QUADS 2048
+
+/**
+   Interleaved vertex layout handed to the renderers.
+*/
+typedef struct gfx_vertex {
+  GLfloat x;
+  GLfloat y;
+  GLfloat u;
+  GLfloat v;
+  color_t color;
+} gfx_vertex_t;
+
+/**
+   A renderer implementing the drawing side of gfx.h.
+*/
+typedef struct gfx_backend {
+  const char* name;
+
+  /**
+     True if the renderer draws into memory and needs no window or opengl
+     context.  Nothing in glfw is used while it runs.
+  */
+  bool   headless;
+
+  /**
+     True if the renderer stretches textures to power of two sizes.  Loads
+     requested with texture_request do it on the decoding thread instead.
+  */
+  bool   power_of_two;
+
+  /** Sets any window hints the renderer needs before the window opens. */
+  void   (*window_hints)(void);
+
+  /**
+      Called once the window is open, or straight away for headless
+      renderers.  Returns false if the renderer can't run on the context it
+      got.
+  */
+  bool   (*init)(int width, int height);
+  void   (*shutdown)(void);
+
+  void   (*begin_2d)(void);
+  void   (*end_2d)(void);
+
+  /** Fills the whole frame with a color. */
+  void   (*clear)(color_t* color);
+
+  /**
+     Uploads RGBA pixels, top row first, into a new texture.  Returns 0 on
+     failure.
+  */
+  GLuint (*texture_create)(const unsigned char* pixels, int width,
+                           int height);
+
+  void   (*texture_delete)(GLuint id);
+
+  /**
+     Draws a run of quads.  Each quad is four vertices going clockwise from
+     the upper left-hand corner.
+
+     @param texture
+       Texture id or 0 for untextured quads.
+  */
+  void   (*draw_quads)(GLuint texture,
+                       const gfx_vertex_t* vertices,
+                       int quad_count);
+
+  /** Draws the outline of a rectangle. */
+  void   (*draw_outline)(rect_t* rect, color_t* color);
+
+  /**
+     Draws an instance layer in one call, uploading its dirty range first.
+     NULL if the renderer can't instance, in which case the layer goes
+     through the sprite batch.
+  */
+  void   (*draw_instances)(instance_layer_t* layer);
+
+  /** Frees anything draw_instances created for a layer.  May be NULL. */
+  void   (*delete_instances)(instance_layer_t* layer);
+
+  /**
+     Copies the frame drawn so far into RGBA pixels, top row first.  Only
+     called after the sprite batch has been flushed.
+  */
+  void   (*read_frame)(unsigned char* pixels, int width, int height);
+} gfx_backend_t;
+
+extern const gfx_backend_t gfx_backend_legacy;
+extern const gfx_backend_t gfx_backend_gl3;
+extern const gfx_backend_t gfx_backend_software;
+
+//==============================================================================
+// Opengl helpers
+//==============================================================================
+
+/*
+  Parts of the backend interface that are the same for every opengl
+  renderer.
+*/
+
+void gfx_gl_clear(color_t* color);
+
+void gfx_gl_texture_delete(GLuint id);
+
+void gfx_gl_read_frame(unsigned char* pixels, int width, int height);
+
+//==============================================================================
+// State cache
+//==============================================================================
+
+/**
+   Forgets the shadowed opengl state.  Needs to be called whenever code
+   outside of the renderers (SOIL for instance) may have changed it.
+*/
+void gfx_state_invalidate(void);
+
+void gfx_state_bind_texture(GLuint id);
+
+void gfx_state_set_enabled(GLenum capability, bool enabled);
+
+void gfx_state_blend_func(GLenum src, GLenum dst);
+
+#endif
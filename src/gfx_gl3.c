@@ -0,0 +1,550 @@
+/**
+   @file gfx_gl3.c
+
+   Opengl 3.3 core profile renderer.  Sprite batches are streamed into a
+   vertex buffer that lives for the whole run and drawn as indexed
+   triangles with a single textured, tinted quad shader.  The orthographic
+   projection is a shader uniform.  Instance layers get a second shader that
+   expands a unit quad per instance.
+*/
+#include <stddef.h>
+#include <string.h>
+
+#include <GL/glfw.h>
+#include <GL/glext.h>
+
+#include "util.h"
+#include "gfx_backend.h"
+
+/**
+   Number of vertices the stream buffer holds.  Batches are written one after
+   another and the buffer is only orphaned once it wraps, so several flushes
+   fit between driver synchronizations.
+*/
+#define STREAM_VERTICES (GFX_BATCH_MAX_QUADS * 4 * 4)
+
+static const char* VERTEX_SHADER =
+  "#version 330 core\n"
+  "layout(location = 0) in vec2 position;\n"
+  "layout(location = 1) in vec2 tex_coord;\n"
+  "layout(location = 2) in vec4 color;\n"
+  "uniform mat4 projection;\n"
+  "out vec2 frag_tex_coord;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_tex_coord = tex_coord;\n"
+  "  frag_color = color;\n"
+  "  gl_Position = projection * vec4(position, 0.0, 1.0);\n"
+  "}\n";
+
+static const char* INSTANCE_VERTEX_SHADER =
+  "#version 330 core\n"
+  "layout(location = 0) in vec2 corner;\n"
+  "layout(location = 3) in vec2 offset;\n"
+  "layout(location = 4) in vec4 tex_rect;\n"
+  "uniform mat4 projection;\n"
+  "uniform vec2 size;\n"
+  "out vec2 frag_tex_coord;\n"
+  "out vec4 frag_color;\n"
+  "void main() {\n"
+  "  frag_tex_coord = mix(tex_rect.xy, tex_rect.zw, corner);\n"
+  "  frag_color = vec4(1.0);\n"
+  "  gl_Position = projection * vec4(offset + corner * size, 0.0, 1.0);\n"
+  "}\n";
+
+static const char* FRAGMENT_SHADER =
+  "#version 330 core\n"
+  "in vec2 frag_tex_coord;\n"
+  "in vec4 frag_color;\n"
+  "uniform sampler2D image;\n"
+  "out vec4 out_color;\n"
+  "void main() {\n"
+  "  out_color = texture(image, frag_tex_coord) * frag_color;\n"
+  "}\n";
+
+/**
+   Entry points that have to be looked up at runtime.  Members drop the gl
+   prefix so they can't collide with prototypes from the system headers.
+*/
+#define GL3_FUNCTIONS(F)                                                \
+  F(PFNGLGENBUFFERSPROC,              GenBuffers)                       \
+  F(PFNGLDELETEBUFFERSPROC,           DeleteBuffers)                    \
+  F(PFNGLBINDBUFFERPROC,              BindBuffer)                       \
+  F(PFNGLBUFFERDATAPROC,              BufferData)                       \
+  F(PFNGLBUFFERSUBDATAPROC,           BufferSubData)                    \
+  F(PFNGLMAPBUFFERRANGEPROC,          MapBufferRange)                   \
+  F(PFNGLUNMAPBUFFERPROC,             UnmapBuffer)                      \
+  F(PFNGLGENVERTEXARRAYSPROC,         GenVertexArrays)                  \
+  F(PFNGLDELETEVERTEXARRAYSPROC,      DeleteVertexArrays)               \
+  F(PFNGLBINDVERTEXARRAYPROC,         BindVertexArray)                  \
+  F(PFNGLENABLEVERTEXATTRIBARRAYPROC, EnableVertexAttribArray)          \
+  F(PFNGLVERTEXATTRIBPOINTERPROC,     VertexAttribPointer)              \
+  F(PFNGLVERTEXATTRIBDIVISORPROC,     VertexAttribDivisor)              \
+  F(PFNGLCREATESHADERPROC,            CreateShader)                     \
+  F(PFNGLDELETESHADERPROC,            DeleteShader)                     \
+  F(PFNGLSHADERSOURCEPROC,            ShaderSource)                     \
+  F(PFNGLCOMPILESHADERPROC,           CompileShader)                    \
+  F(PFNGLGETSHADERIVPROC,             GetShaderiv)                      \
+  F(PFNGLGETSHADERINFOLOGPROC,        GetShaderInfoLog)                 \
+  F(PFNGLCREATEPROGRAMPROC,           CreateProgram)                    \
+  F(PFNGLDELETEPROGRAMPROC,           DeleteProgram)                    \
+  F(PFNGLATTACHSHADERPROC,            AttachShader)                     \
+  F(PFNGLLINKPROGRAMPROC,             LinkProgram)                      \
+  F(PFNGLGETPROGRAMIVPROC,            GetProgramiv)                     \
+  F(PFNGLGETPROGRAMINFOLOGPROC,       GetProgramInfoLog)                \
+  F(PFNGLUSEPROGRAMPROC,              UseProgram)                       \
+  F(PFNGLGETUNIFORMLOCATIONPROC,      GetUniformLocation)               \
+  F(PFNGLUNIFORM1IPROC,               Uniform1i)                        \
+  F(PFNGLUNIFORM2FPROC,               Uniform2f)                        \
+  F(PFNGLUNIFORMMATRIX4FVPROC,        UniformMatrix4fv)                 \
+  F(PFNGLACTIVETEXTUREPROC,           ActiveTexture)                    \
+  F(PFNGLDRAWELEMENTSBASEVERTEXPROC,  DrawElementsBaseVertex)          \
+  F(PFNGLDRAWELEMENTSINSTANCEDPROC,   DrawElementsInstanced)
+
+#define GL3_DECLARE(type, name) type name;
+
+static struct {
+  GL3_FUNCTIONS(GL3_DECLARE)
+
+  GLuint program;
+  GLint  projection_location;
+
+  GLuint instance_program;
+  GLint  instance_projection_location;
+  GLint  instance_size_location;
+
+  /** Program currently in use. */
+  GLuint current_program;
+
+  GLuint vertex_array;
+  GLuint vertex_buffer;
+  GLuint index_buffer;
+
+  /** Unit quad corners shared by every instance layer. */
+  GLuint corner_buffer;
+
+  /** Next free vertex in the stream buffer. */
+  int    stream_offset;
+
+  /** 1x1 white texture drawn for untextured quads. */
+  GLuint white_texture;
+} gl3;
+
+static bool
+load_functions(void) {
+  bool result = true;
+
+#define GL3_LOAD(type, name)                                    \
+  gl3.name = (type)glfwGetProcAddress("gl" #name);              \
+  if(gl3.name == NULL) {                                        \
+    logmsg("Missing opengl entry point gl%s.", #name);          \
+    result = false;                                             \
+  }
+
+  GL3_FUNCTIONS(GL3_LOAD)
+
+#undef GL3_LOAD
+
+  return result;
+}
+
+static GLuint
+compile_shader(GLenum type, const char* source) {
+  GLuint shader = gl3.CreateShader(type);
+  GLint  compiled;
+
+  gl3.ShaderSource(shader, 1, &source, NULL);
+  gl3.CompileShader(shader);
+  gl3.GetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+  if(!compiled) {
+    char info[512];
+
+    gl3.GetShaderInfoLog(shader, sizeof(info), NULL, info);
+    logmsg("Unable to compile shader: %s", info);
+    gl3.DeleteShader(shader);
+    shader = 0;
+  }
+
+  return shader;
+}
+
+/**
+   Links a program from vertex and fragment shader source.
+
+   @return
+     The program or 0 on failure.
+*/
+static GLuint
+build_program(const char* vertex_source, const char* fragment_source) {
+  GLuint vertex = compile_shader(GL_VERTEX_SHADER, vertex_source);
+  GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+  GLuint program = 0;
+  GLint  linked = GL_FALSE;
+
+  if(vertex != 0 && fragment != 0) {
+    program = gl3.CreateProgram();
+    gl3.AttachShader(program, vertex);
+    gl3.AttachShader(program, fragment);
+    gl3.LinkProgram(program);
+    gl3.GetProgramiv(program, GL_LINK_STATUS, &linked);
+
+    if(!linked) {
+      char info[512];
+
+      gl3.GetProgramInfoLog(program, sizeof(info), NULL, info);
+      logmsg("Unable to link shader program: %s", info);
+      gl3.DeleteProgram(program);
+      program = 0;
+    }
+  }
+
+  // The program keeps what it needs.
+  if(vertex != 0) {
+    gl3.DeleteShader(vertex);
+  }
+  if(fragment != 0) {
+    gl3.DeleteShader(fragment);
+  }
+
+  return program;
+}
+
+static void
+use_program(GLuint program) {
+  if(gl3.current_program != program) {
+    gl3.UseProgram(program);
+    gl3.current_program = program;
+  }
+}
+
+static void
+create_buffers(void) {
+  GLushort* indices = new_array(GLushort, GFX_BATCH_MAX_QUADS * 6);
+  color_t   white = COLOR_WHITE;
+  GLfloat   corners[] = { 0, 0,  1, 0,  1, 1,  0, 1 };
+
+  gl3.GenVertexArrays(1, &gl3.vertex_array);
+  gl3.BindVertexArray(gl3.vertex_array);
+
+  gl3.GenBuffers(1, &gl3.vertex_buffer);
+  gl3.BindBuffer(GL_ARRAY_BUFFER, gl3.vertex_buffer);
+  gl3.BufferData(GL_ARRAY_BUFFER, STREAM_VERTICES * sizeof(gfx_vertex_t),
+                 NULL, GL_STREAM_DRAW);
+
+  gl3.EnableVertexAttribArray(0);
+  gl3.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(gfx_vertex_t),
+                          (void*)offsetof(gfx_vertex_t, x));
+  gl3.EnableVertexAttribArray(1);
+  gl3.VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(gfx_vertex_t),
+                          (void*)offsetof(gfx_vertex_t, u));
+  gl3.EnableVertexAttribArray(2);
+  gl3.VertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(gfx_vertex_t),
+                          (void*)offsetof(gfx_vertex_t, color));
+
+  // Quads are drawn as two triangles sharing the diagonal.
+  for(int i = 0; i < GFX_BATCH_MAX_QUADS; i++) {
+    GLushort* quad = indices + i * 6;
+    GLushort  base = i * 4;
+
+    quad[0] = base;
+    quad[1] = base + 1;
+    quad[2] = base + 2;
+    quad[3] = base;
+    quad[4] = base + 2;
+    quad[5] = base + 3;
+  }
+
+  gl3.GenBuffers(1, &gl3.index_buffer);
+  gl3.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl3.index_buffer);
+  gl3.BufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 GFX_BATCH_MAX_QUADS * 6 * sizeof(GLushort), indices,
+                 GL_STATIC_DRAW);
+  delete(indices);
+
+  glGenTextures(1, &gl3.white_texture);
+  gfx_state_bind_texture(gl3.white_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, &white);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  gl3.GenBuffers(1, &gl3.corner_buffer);
+  gl3.BindBuffer(GL_ARRAY_BUFFER, gl3.corner_buffer);
+  gl3.BufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  gl3.BindBuffer(GL_ARRAY_BUFFER, gl3.vertex_buffer);
+
+  gl3.stream_offset = 0;
+}
+
+static void
+gl3_window_hints(void) {
+  glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+  glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 3);
+  glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwOpenWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+}
+
+static bool
+gl3_init(int width, int height) {
+  bool result = load_functions();
+
+  if(result) {
+    gl3.program = build_program(VERTEX_SHADER, FRAGMENT_SHADER);
+    gl3.instance_program = build_program(INSTANCE_VERTEX_SHADER,
+                                         FRAGMENT_SHADER);
+    result = gl3.program != 0 && gl3.instance_program != 0;
+  }
+
+  if(result) {
+    gl3.projection_location = 
+      gl3.GetUniformLocation(gl3.program, "projection");
+    gl3.instance_projection_location = 
+      gl3.GetUniformLocation(gl3.instance_program, "projection");
+    gl3.instance_size_location = 
+      gl3.GetUniformLocation(gl3.instance_program, "size");
+
+    use_program(gl3.instance_program);
+    gl3.Uniform1i(gl3.GetUniformLocation(gl3.instance_program, "image"), 0);
+    use_program(gl3.program);
+    gl3.Uniform1i(gl3.GetUniformLocation(gl3.program, "image"), 0);
+    gl3.ActiveTexture(GL_TEXTURE0);
+
+    create_buffers();
+  }
+
+  return result;
+}
+
+static void
+gl3_shutdown(void) {
+  if(gl3.program != 0) {
+    gl3.UseProgram(0);
+    gl3.DeleteProgram(gl3.program);
+    gl3.DeleteProgram(gl3.instance_program);
+    gl3.DeleteBuffers(1, &gl3.vertex_buffer);
+    gl3.DeleteBuffers(1, &gl3.index_buffer);
+    gl3.DeleteBuffers(1, &gl3.corner_buffer);
+    gl3.DeleteVertexArrays(1, &gl3.vertex_array);
+    glDeleteTextures(1, &gl3.white_texture);
+  }
+
+  memset(&gl3, 0, sizeof(gl3));
+}
+
+static void
+gl3_begin_2d(void) {
+  GLint   viewport[4];
+  GLfloat projection[16] = { 0 };
+
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  // Same orthographic projection as the fixed function renderer: the origin
+  // is the upper left-hand corner of the viewport.
+  projection[0] = 2.0f / viewport[2];
+  projection[5] = -2.0f / viewport[3];
+  projection[10] = -1.0f;
+  projection[12] = -1.0f - 2.0f * viewport[0] / viewport[2];
+  projection[13] = 1.0f + 2.0f * viewport[1] / viewport[3];
+  projection[15] = 1.0f;
+
+  use_program(gl3.instance_program);
+  gl3.UniformMatrix4fv(gl3.instance_projection_location, 1, GL_FALSE,
+                       projection);
+  use_program(gl3.program);
+  gl3.UniformMatrix4fv(gl3.projection_location, 1, GL_FALSE, projection);
+  gl3.BindVertexArray(gl3.vertex_array);
+  gl3.BindBuffer(GL_ARRAY_BUFFER, gl3.vertex_buffer);
+
+  glDisable(GL_DEPTH_TEST);
+}
+
+static void
+gl3_end_2d(void) {
+}
+
+static GLuint
+gl3_texture_create(const unsigned char* pixels, int width, int height) {
+  GLuint id = 0;
+
+  // SOIL's texture upload queries GL_EXTENSIONS, which core profiles don't
+  // have, so the pixels are uploaded here.
+  glGenTextures(1, &id);
+  gfx_state_bind_texture(id);
+
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, pixels);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+  return id;
+}
+
+/**
+   Copies vertices into the stream buffer.
+
+   @return
+     Index of the first copied vertex in the buffer.
+*/
+static GLint
+stream_vertices(const gfx_vertex_t* vertices, int count) {
+  GLint base;
+  void* dest;
+
+  // Orphan the buffer once it wraps so the driver can hand out fresh
+  // storage instead of waiting on draws still using the old contents.
+  if(gl3.stream_offset + count > STREAM_VERTICES) {
+    gl3.BufferData(GL_ARRAY_BUFFER, STREAM_VERTICES * sizeof(gfx_vertex_t),
+                   NULL, GL_STREAM_DRAW);
+    gl3.stream_offset = 0;
+  }
+
+  base = gl3.stream_offset;
+  dest = gl3.MapBufferRange(GL_ARRAY_BUFFER, base * sizeof(gfx_vertex_t),
+                            count * sizeof(gfx_vertex_t),
+                            GL_MAP_WRITE_BIT |
+                            GL_MAP_INVALIDATE_RANGE_BIT |
+                            GL_MAP_UNSYNCHRONIZED_BIT);
+  memcpy(dest, vertices, count * sizeof(gfx_vertex_t));
+  gl3.UnmapBuffer(GL_ARRAY_BUFFER);
+
+  gl3.stream_offset += count;
+  return base;
+}
+
+/**
+   Goes back to drawing from the stream buffer after an instance layer.
+*/
+static void
+use_stream(void) {
+  if(gl3.current_program != gl3.program) {
+    use_program(gl3.program);
+    gl3.BindVertexArray(gl3.vertex_array);
+    gl3.BindBuffer(GL_ARRAY_BUFFER, gl3.vertex_buffer);
+  }
+}
+
+static void
+gl3_draw_quads(GLuint texture, const gfx_vertex_t* vertices, int quad_count) {
+  GLint base;
+
+  use_stream();
+  base = stream_vertices(vertices, quad_count * 4);
+
+  gfx_state_bind_texture(texture != 0 ? texture : gl3.white_texture);
+  gfx_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gfx_state_set_enabled(GL_BLEND, true);
+
+  gl3.DrawElementsBaseVertex(GL_TRIANGLES, quad_count * 6, GL_UNSIGNED_SHORT,
+                             NULL, base);
+}
+
+static void
+gl3_draw_outline(rect_t* rect, color_t* color) {
+  gfx_vertex_t corners[4] = {
+    { rect->x,               rect->y,                0, 0, *color },
+    { rect->x + rect->width, rect->y,                0, 0, *color },
+    { rect->x + rect->width, rect->y + rect->height, 0, 0, *color },
+    { rect->x,               rect->y + rect->height, 0, 0, *color }
+  };
+  GLint base;
+
+  use_stream();
+  base = stream_vertices(corners, 4);
+
+  gfx_state_bind_texture(gl3.white_texture);
+  gfx_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gfx_state_set_enabled(GL_BLEND, true);
+
+  glDrawArrays(GL_LINE_LOOP, base, 4);
+}
+
+/**
+   Creates the vertex array and instance buffer for a layer.
+*/
+static void
+create_instances(instance_layer_t* layer) {
+  gl3.GenVertexArrays(1, &layer->vertex_array);
+  gl3.BindVertexArray(layer->vertex_array);
+  gl3.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl3.index_buffer);
+
+  gl3.BindBuffer(GL_ARRAY_BUFFER, gl3.corner_buffer);
+  gl3.EnableVertexAttribArray(0);
+  gl3.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+  gl3.GenBuffers(1, &layer->buffer);
+  gl3.BindBuffer(GL_ARRAY_BUFFER, layer->buffer);
+  gl3.BufferData(GL_ARRAY_BUFFER, layer->count * sizeof(gfx_instance_t),
+                 NULL, GL_DYNAMIC_DRAW);
+
+  gl3.EnableVertexAttribArray(3);
+  gl3.VertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(gfx_instance_t),
+                          (void*)offsetof(gfx_instance_t, x));
+  gl3.VertexAttribDivisor(3, 1);
+  gl3.EnableVertexAttribArray(4);
+  gl3.VertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(gfx_instance_t),
+                          (void*)offsetof(gfx_instance_t, start_u));
+  gl3.VertexAttribDivisor(4, 1);
+}
+
+static void
+gl3_draw_instances(instance_layer_t* layer) {
+  use_program(gl3.instance_program);
+
+  if(layer->vertex_array == 0) {
+    create_instances(layer);
+  } else {
+    gl3.BindVertexArray(layer->vertex_array);
+    gl3.BindBuffer(GL_ARRAY_BUFFER, layer->buffer);
+  }
+
+  // Only what changed goes up.
+  if(layer->dirty_end > layer->dirty_start) {
+    gl3.BufferSubData(GL_ARRAY_BUFFER,
+                      layer->dirty_start * sizeof(gfx_instance_t),
+                      (layer->dirty_end - layer->dirty_start) *
+                      sizeof(gfx_instance_t),
+                      layer->instances + layer->dirty_start);
+  }
+
+  gl3.Uniform2f(gl3.instance_size_location, layer->width, layer->height);
+  gfx_state_bind_texture(layer->texture->id);
+  gfx_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gfx_state_set_enabled(GL_BLEND, true);
+
+  gl3.DrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, NULL,
+                            layer->count);
+}
+
+static void
+gl3_delete_instances(instance_layer_t* layer) {
+  if(layer->vertex_array != 0) {
+    gl3.DeleteBuffers(1, &layer->buffer);
+    gl3.DeleteVertexArrays(1, &layer->vertex_array);
+
+    // The stream vertex array may need rebinding.
+    gl3.current_program = 0;
+  }
+}
+
+const gfx_backend_t gfx_backend_gl3 = {
+  "gl3",
+  false,
+  false,
+  gl3_window_hints,
+  gl3_init,
+  gl3_shutdown,
+  gl3_begin_2d,
+  gl3_end_2d,
+  gfx_gl_clear,
+  gl3_texture_create,
+  gfx_gl_texture_delete,
+  gl3_draw_quads,
+  gl3_draw_outline,
+  gl3_draw_instances,
+  gl3_delete_instances,
+  gfx_gl_read_frame
+};
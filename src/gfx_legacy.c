@@ -0,0 +1,143 @@
+/**
+   @file gfx_legacy.c
+
+   Fixed function opengl renderer.  Works on any opengl 1.1 context and
+   draws the sprite batch from client side vertex arrays.
+*/
+#include <GL/glfw.h>
+#include "soil/SOIL.h"
+
+#include "gfx_backend.h"
+
+static void
+legacy_window_hints(void) {
+  // The default context is fine.
+}
+
+static bool
+legacy_init(int width, int height) {
+  return true;
+}
+
+static void
+legacy_shutdown(void) {
+}
+
+/*
+  More info and base source:
+  http://www.gamedev.net/page/resources/_/technical/opengl/rendering-efficient-2d-sprites-in-opengl-using-r2429
+*/
+static void
+legacy_begin_2d(void) {
+  GLint viewport[4];
+
+  // Get a copy of the viewport
+  glGetIntegerv(GL_VIEWPORT, viewport);
+
+  // Save a copy of the projection matrix so that we can restore it
+  // when it's time to do 3D rendering again.
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+
+  // Set up the orthographic projection
+  glOrtho(viewport[0],  viewport[0] + viewport[2],
+          viewport[1] + viewport[3], viewport[1],
+          -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  // Make sure depth testing and lighting are disabled for 2D rendering until
+  // we are finished rendering in 2D
+  glPushAttrib(GL_DEPTH_BUFFER_BIT | GL_LIGHTING_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_LIGHTING);
+
+  // The sprite batch draws from client side arrays.
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+}
+
+static void
+legacy_end_2d(void) {
+  glPopClientAttrib();
+  glPopAttrib();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+}
+
+static GLuint
+legacy_texture_create(const unsigned char* pixels, int width, int height) {
+  GLuint id;
+
+  id = SOIL_create_OGL_texture(pixels, width, height, SOIL_LOAD_RGBA,
+                               SOIL_CREATE_NEW_ID,
+                               SOIL_FLAG_POWER_OF_TWO |
+                               SOIL_FLAG_TEXTURE_REPEATS |
+                               SOIL_FLAG_COMPRESS_TO_DXT);
+
+  // SOIL leaves its new texture bound.
+  gfx_state_invalidate();
+
+  return id;
+}
+
+static void
+legacy_draw_quads(GLuint texture, const gfx_vertex_t* vertices,
+                  int quad_count)
+{
+  if(texture != 0) {
+    gfx_state_bind_texture(texture);
+  }
+  gfx_state_set_enabled(GL_TEXTURE_2D, texture != 0);
+  gfx_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gfx_state_set_enabled(GL_BLEND, true);
+
+  glVertexPointer(2, GL_FLOAT, sizeof(gfx_vertex_t), &vertices->x);
+  glTexCoordPointer(2, GL_FLOAT, sizeof(gfx_vertex_t), &vertices->u);
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(gfx_vertex_t),
+                 &vertices->color);
+
+  glDrawArrays(GL_QUADS, 0, quad_count * 4);
+}
+
+static void
+legacy_draw_outline(rect_t* rect, color_t* color) {
+  gfx_state_set_enabled(GL_TEXTURE_2D, false);
+  gfx_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gfx_state_set_enabled(GL_BLEND, true);
+
+  glBegin(GL_LINE_LOOP);
+  {
+    glColor4ub(color->red, color->green, color->blue, color->alpha);
+    glVertex2i(rect->x, rect->y);
+    glVertex2i(rect->x + rect->width, rect->y);
+    glVertex2i(rect->x + rect->width, rect->y + rect->height);
+    glVertex2i(rect->x, rect->y + rect->height);
+  }
+  glEnd();
+}
+
+const gfx_backend_t gfx_backend_legacy = {
+  "legacy",
+  false,
+  true,
+  legacy_window_hints,
+  legacy_init,
+  legacy_shutdown,
+  legacy_begin_2d,
+  legacy_end_2d,
+  gfx_gl_clear,
+  legacy_texture_create,
+  gfx_gl_texture_delete,
+  legacy_draw_quads,
+  legacy_draw_outline,
+  NULL,
+  NULL,
+  gfx_gl_read_frame
+};
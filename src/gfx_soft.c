@@ -0,0 +1,370 @@
+/**
+   @file gfx_soft.c
+
+   Software renderer.  Draws on the cpu into an RGBA framebuffer in memory,
+   so frames can be rendered, timed and saved without a display or gpu.
+
+   Quads are sampled nearest neighbour, multiplied by their vertex color and
+   blended with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA the same way the opengl
+   renderers draw them.  Spans are blended four pixels at a time with SSE2
+   when the compiler targets it; the scalar path gives identical results.
+*/
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util.h"
+#include "gfx_backend.h"
+
+typedef struct soft_texture {
+  /** RGBA pixels, top row first.  NULL while the slot is free. */
+  uint32_t* pixels;
+  int       width;
+  int       height;
+} soft_texture_t;
+
+static struct {
+  /** RGBA pixels, top row first. */
+  uint32_t*       frame;
+  int             width;
+  int             height;
+
+  /** Texture id n lives in slot n - 1. */
+  soft_texture_t* textures;
+  int             texture_count;
+} soft;
+
+//==============================================================================
+// Blending
+//==============================================================================
+
+/**
+   Divides a product of two bytes by 255, rounding to nearest.
+*/
+static uint32_t
+div255(uint32_t x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+/**
+   Multiplies a texel by a color and blends it over a framebuffer pixel.
+*/
+static void
+blend_pixel(uint32_t* pixel, uint32_t texel, color_t* color) {
+  unsigned char* dst = (unsigned char*)pixel;
+  unsigned char* src = (unsigned char*)&texel;
+  unsigned char  modulated[4];
+  uint32_t       inverse;
+
+  modulated[0] = div255(src[0] * color->red);
+  modulated[1] = div255(src[1] * color->green);
+  modulated[2] = div255(src[2] * color->blue);
+  modulated[3] = div255(src[3] * color->alpha);
+  inverse = 255 - modulated[3];
+
+  for(int i = 0; i < 4; i++) {
+    dst[i] = div255(modulated[i] * modulated[3] + dst[i] * inverse);
+  }
+}
+
+#ifdef __SSE2__
+static __m128i
+div255_epi16(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/**
+   blend_pixel for two pixels whose channels have been widened to 16 bits.
+*/
+static __m128i
+blend_pixels_sse2(__m128i src, __m128i dst, __m128i color) {
+  __m128i alpha;
+  __m128i inverse;
+
+  src = div255_epi16(_mm_mullo_epi16(src, color));
+
+  // Spread each pixel's alpha over its four channels.
+  alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+  inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+
+  return div255_epi16(_mm_add_epi16(_mm_mullo_epi16(src, alpha),
+                                    _mm_mullo_epi16(dst, inverse)));
+}
+#endif
+
+/**
+   Gets the texel under a 16.16 fixed point column, clamped to the row.
+*/
+static uint32_t
+fetch_texel(const uint32_t* texels, int32_t u, int max_u) {
+  int x = u >> 16;
+
+  return texels[x < 0 ? 0 : (x > max_u ? max_u : x)];
+}
+
+/**
+   Blends one row of a quad into the framebuffer.
+
+   @param texels
+     Texture row the span samples or NULL for an untextured span.
+   @param u
+     16.16 fixed point texture column under the first pixel.
+   @param u_step
+     Texture columns moved per pixel, 16.16 fixed point.
+   @param max_u
+     Last column of the texture row.
+*/
+static void
+draw_span(uint32_t* pixels, int count, const uint32_t* texels, int32_t u,
+          int32_t u_step, int max_u, color_t* color)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  __m128i white = _mm_set1_epi32(-1);
+  __m128i color16 = _mm_setr_epi16(color->red, color->green, color->blue,
+                                   color->alpha, color->red, color->green,
+                                   color->blue, color->alpha);
+
+  for(; i + 4 <= count; i += 4) {
+    __m128i src = white;
+    __m128i dst = _mm_loadu_si128((__m128i*)(pixels + i));
+    __m128i low;
+    __m128i high;
+
+    if(texels != NULL) {
+      src = _mm_setr_epi32(fetch_texel(texels, u, max_u),
+                           fetch_texel(texels, u + u_step, max_u),
+                           fetch_texel(texels, u + u_step * 2, max_u),
+                           fetch_texel(texels, u + u_step * 3, max_u));
+      u += u_step * 4;
+    }
+
+    low = blend_pixels_sse2(_mm_unpacklo_epi8(src, zero),
+                            _mm_unpacklo_epi8(dst, zero), color16);
+    high = blend_pixels_sse2(_mm_unpackhi_epi8(src, zero),
+                             _mm_unpackhi_epi8(dst, zero), color16);
+
+    _mm_storeu_si128((__m128i*)(pixels + i), _mm_packus_epi16(low, high));
+  }
+#endif
+
+  for(; i < count; i++) {
+    uint32_t texel = 0xFFFFFFFF;
+
+    if(texels != NULL) {
+      texel = fetch_texel(texels, u, max_u);
+      u += u_step;
+    }
+
+    blend_pixel(pixels + i, texel, color);
+  }
+}
+
+/**
+   Rasterizes one axis aligned quad.  Pixels are covered when their centers
+   fall inside the quad, as in opengl.
+
+   @param texture
+     Texture to sample or NULL for an untextured quad.
+*/
+static void
+draw_quad(const gfx_vertex_t* vertices, soft_texture_t* texture) {
+  float   x0 = vertices[0].x, y0 = vertices[0].y;
+  float   x1 = vertices[2].x, y1 = vertices[2].y;
+  float   u0 = vertices[0].u, v0 = vertices[0].v;
+  float   u1 = vertices[2].u, v1 = vertices[2].v;
+  color_t color = vertices[0].color;
+  int     left, right, top, bottom;
+  float   u_step = 0.0f, v_step = 0.0f;
+  int32_t u_start = 0;
+
+  if(x1 < x0) {
+    float temp = x0; x0 = x1; x1 = temp;
+    temp = u0; u0 = u1; u1 = temp;
+  }
+
+  if(y1 < y0) {
+    float temp = y0; y0 = y1; y1 = temp;
+    temp = v0; v0 = v1; v1 = temp;
+  }
+
+  left = max(0, (int)ceilf(x0 - 0.5f));
+  right = min(soft.width, (int)ceilf(x1 - 0.5f));
+  top = max(0, (int)ceilf(y0 - 0.5f));
+  bottom = min(soft.height, (int)ceilf(y1 - 0.5f));
+
+  if(left >= right || top >= bottom) {
+    return;
+  }
+
+  if(texture != NULL) {
+    u_step = (u1 - u0) * texture->width / (x1 - x0);
+    v_step = (v1 - v0) * texture->height / (y1 - y0);
+    u_start = (int32_t)floorf((u0 * texture->width +
+                               (left + 0.5f - x0) * u_step) * 65536.0f);
+  }
+
+  for(int y = top; y < bottom; y++) {
+    const uint32_t* texels = NULL;
+
+    if(texture != NULL) {
+      int row = (int)floorf(v0 * texture->height + (y + 0.5f - y0) * v_step);
+
+      row = row < 0 ? 0 : min(row, texture->height - 1);
+      texels = texture->pixels + row * texture->width;
+    }
+
+    draw_span(soft.frame + y * soft.width + left, right - left, texels,
+              u_start, (int32_t)(u_step * 65536.0f),
+              texture != NULL ? texture->width - 1 : 0, &color);
+  }
+}
+
+//==============================================================================
+// Backend
+//==============================================================================
+
+static void
+soft_window_hints(void) {
+  // Never opens a window.
+}
+
+static bool
+soft_init(int width, int height) {
+  soft.width = width;
+  soft.height = height;
+  soft.frame = new_array(uint32_t, width * height);
+
+  return soft.frame != NULL;
+}
+
+static void
+soft_shutdown(void) {
+  for(int i = 0; i < soft.texture_count; i++) {
+    delete(soft.textures[i].pixels);
+  }
+
+  delete(soft.textures);
+  delete(soft.frame);
+  memset(&soft, 0, sizeof(soft));
+}
+
+static void
+soft_begin_2d(void) {
+}
+
+static void
+soft_end_2d(void) {
+}
+
+static void
+soft_clear(color_t* color) {
+  uint32_t pixel;
+
+  memcpy(&pixel, color, sizeof(pixel));
+
+  for(int i = 0; i < soft.width * soft.height; i++) {
+    soft.frame[i] = pixel;
+  }
+}
+
+static GLuint
+soft_texture_create(const unsigned char* pixels, int width, int height) {
+  int slot = 0;
+
+  while(slot < soft.texture_count && soft.textures[slot].pixels != NULL) {
+    slot++;
+  }
+
+  if(slot == soft.texture_count) {
+    soft.texture_count = max(soft.texture_count * 2, 8);
+    soft.textures = realloc(soft.textures,
+                            soft.texture_count * sizeof(soft_texture_t));
+    if(soft.textures == NULL) {
+      logmsg("Unable to grow the software texture list.");
+      exit(1);
+    }
+
+    memset(soft.textures + slot, 0,
+           (soft.texture_count - slot) * sizeof(soft_texture_t));
+  }
+
+  soft.textures[slot].pixels = new_array(uint32_t, width * height);
+  soft.textures[slot].width = width;
+  soft.textures[slot].height = height;
+  memcpy(soft.textures[slot].pixels, pixels, width * height * 4);
+
+  return slot + 1;
+}
+
+static void
+soft_texture_delete(GLuint id) {
+  soft_texture_t* texture = soft.textures + id - 1;
+
+  delete(texture->pixels);
+  texture->pixels = NULL;
+}
+
+static void
+soft_draw_quads(GLuint texture, const gfx_vertex_t* vertices, int quad_count) {
+  soft_texture_t* source = texture != 0 ? soft.textures + texture - 1 : NULL;
+
+  for(int i = 0; i < quad_count; i++) {
+    draw_quad(vertices + i * 4, source);
+  }
+}
+
+static void
+soft_draw_outline(rect_t* rect, color_t* color) {
+  // A one pixel frame just inside the rectangle, as four untextured quads.
+  rect_t edges[4] = {
+    { rect->x, rect->y, rect->width, 1 },
+    { rect->x, rect->y + rect->height - 1, rect->width, 1 },
+    { rect->x, rect->y + 1, 1, rect->height - 2 },
+    { rect->x + rect->width - 1, rect->y + 1, 1, rect->height - 2 }
+  };
+
+  for(int i = 0; i < 4; i++) {
+    gfx_vertex_t vertices[4];
+
+    memset(vertices, 0, sizeof(vertices));
+    vertices[0].x = edges[i].x;
+    vertices[0].y = edges[i].y;
+    vertices[0].color = *color;
+    vertices[2].x = edges[i].x + edges[i].width;
+    vertices[2].y = edges[i].y + edges[i].height;
+
+    draw_quad(vertices, NULL);
+  }
+}
+
+static void
+soft_read_frame(unsigned char* pixels, int width, int height) {
+  memcpy(pixels, soft.frame, width * height * 4);
+}
+
+const gfx_backend_t gfx_backend_software = {
+  "software",
+  true,
+  false,
+  soft_window_hints,
+  soft_init,
+  soft_shutdown,
+  soft_begin_2d,
+  soft_end_2d,
+  soft_clear,
+  soft_texture_create,
+  soft_texture_delete,
+  soft_draw_quads,
+  soft_draw_outline,
+  NULL,
+  NULL,
+  soft_read_frame
+};
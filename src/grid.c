@@ -0,0 +1,77 @@
+#include <math.h>
+
+#include "util.h"
+#include "jobs.h"
+#include "grid.h"
+
+grid_t*
+grid_new(int count, skill_level_t skill, texture_t* texture) {
+  grid_t* grid = new(grid_t);
+  int     columns = (int)ceil(sqrt(count));
+  int     rows = (count + columns - 1) / columns;
+  float   cell_width = SCREEN_WIDTH / (float)columns;
+  float   cell_height = SCREEN_HEIGHT / (float)rows;
+
+  grid->count = count;
+  grid->games = new_array(game_t*, count);
+  grid->run = quad_run_new(texture, count * (skill * skill - 1));
+
+  for(int i = 0; i < count; i++) {
+    int    column = i % columns;
+    int    row = i / columns;
+    rect_t viewport;
+
+    viewport.x = lroundf(column * cell_width) + GRID_GAP / 2;
+    viewport.y = lroundf(row * cell_height) + GRID_GAP / 2;
+    viewport.width = lroundf((column + 1) * cell_width) - GRID_GAP / 2 -
+      viewport.x;
+    viewport.height = lroundf((row + 1) * cell_height) - GRID_GAP / 2 -
+      viewport.y;
+
+    grid->games[i] = game_new(skill, texture);
+    game_set_viewport(grid->games[i], &viewport);
+  }
+
+  logmsg("Started %d boards in a %dx%d grid, updated on %d threads.", count,
+         columns, rows, jobs_thread_count());
+
+  return grid;
+}
+
+void
+grid_delete(grid_t* grid) {
+  for(int i = 0; i < grid->count; i++) {
+    game_end(grid->games[i]);
+  }
+
+  quad_run_delete(grid->run);
+  delete(grid->games);
+  delete(grid);
+}
+
+static void
+update_boards(void* data, int start, int end) {
+  grid_t* grid = data;
+
+  for(int i = start; i < end; i++) {
+    game_move_random(grid->games[i]);
+    game_update(grid->games[i], grid->delta);
+  }
+}
+
+void
+grid_update(grid_t* grid, double delta) {
+  grid->delta = delta;
+  jobs_parallel_for(update_boards, grid, grid->count, GRID_BOARDS_PER_TASK);
+}
+
+void
+grid_render(grid_t* grid) {
+  quad_run_clear(grid->run);
+
+  for(int i = 0; i < grid->count; i++) {
+    game_add_board_quads(grid->games[i], grid->run);
+  }
+
+  quad_run_render(grid->run);
+}
@@ -0,0 +1,57 @@
+/**
+   @file grid.h
+
+   Runs many independent games at once, laid out in a grid filling the
+   window, for spectating tournaments.  The boards share one texture and are
+   drawn together in one quad run.  Their updates are spread over the job
+   system; drawing stays on the calling thread.
+*/
+#ifndef GRID_H
+#define GRID_H
+
+#include "game.h"
+
+/** Most boards updated by one job. */
+#define GRID_BOARDS_PER_TASK 16
+
+/** Pixels left between neighbouring boards. */
+#define GRID_GAP 2
+
+typedef struct grid {
+  game_t**    games;
+  int         count;
+
+  /** Every board's tiles, rebuilt each frame. */
+  quad_run_t* run;
+
+  /** Time the boards are moved on by in the running update. */
+  double      delta;
+} grid_t;
+
+/**
+   Starts a grid of new games.
+
+   @param count
+     Number of boards.
+   @param texture
+     Picture every board is cut from.
+*/
+grid_t* grid_new(int count, skill_level_t skill, texture_t* texture);
+
+/**
+   Ends every game and frees the grid.
+*/
+void grid_delete(grid_t* grid);
+
+/**
+   Starts a random move on every board waiting for one and updates all of
+   the boards, spread over the job system.
+*/
+void grid_update(grid_t* grid, double delta);
+
+/**
+   Draws every board.
+*/
+void grid_render(grid_t* grid);
+
+#endif
@@ -0,0 +1,83 @@
+#include <GL/glfw.h>
+
+#include "profile.h"
+#include "input.h"
+
+static struct {
+  input_event_t events[INPUT_QUEUE_SIZE];
+
+  /** Events pushed so far.  Only input_push moves it. */
+  unsigned int  head;
+  /** Events popped so far.  Only input_pop moves it. */
+  unsigned int  tail;
+
+  unsigned int  dropped;
+} queue;
+
+static void GLFWCALL
+on_mouse_button(int button, int action) {
+  input_event_t event;
+
+  event.type = action == GLFW_PRESS ? INPUT_MOUSE_DOWN : INPUT_MOUSE_UP;
+  event.code = button;
+  event.time = profile_now();
+  glfwGetMousePos(&event.x, &event.y);
+
+  input_push(&event);
+}
+
+static void GLFWCALL
+on_key(int key, int action) {
+  input_event_t event;
+
+  event.type = action == GLFW_PRESS ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+  event.code = key;
+  event.time = profile_now();
+  glfwGetMousePos(&event.x, &event.y);
+
+  input_push(&event);
+}
+
+void
+input_init(void) {
+  glfwSetMouseButtonCallback(on_mouse_button);
+  glfwSetKeyCallback(on_key);
+}
+
+bool
+input_push(const input_event_t* event) {
+  unsigned int head = queue.head;
+  unsigned int tail = __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE);
+
+  if(head - tail == INPUT_QUEUE_SIZE) {
+    queue.dropped++;
+    return false;
+  }
+
+  queue.events[head & (INPUT_QUEUE_SIZE - 1)] = *event;
+
+  // Publishes the event before the consumer can see the new head.
+  __atomic_store_n(&queue.head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool
+input_pop(input_event_t* event) {
+  unsigned int tail = queue.tail;
+  unsigned int head = __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE);
+
+  if(head == tail) {
+    return false;
+  }
+
+  *event = queue.events[tail & (INPUT_QUEUE_SIZE - 1)];
+
+  // Hands the slot back only once it has been copied out.
+  __atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+unsigned int
+input_dropped_count(void) {
+  return queue.dropped;
+}
@@ -0,0 +1,70 @@
+/**
+   @file input.h
+
+   Collects mouse and key events from glfw's callbacks into a queue, each
+   stamped with the time glfw delivered it.  The main loop drains the queue
+   once per pass, so every press is seen exactly once no matter how short it
+   was or how long the button is held.
+
+   The queue is a single producer, single consumer ring that needs no locks,
+   so the callbacks can be moved to another thread without changing it.
+*/
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+
+/** Number of events the queue holds.  Must be a power of two. */
+#define INPUT_QUEUE_SIZE 256
+
+typedef enum input_event_type {
+  INPUT_MOUSE_DOWN,
+  INPUT_MOUSE_UP,
+  INPUT_KEY_DOWN,
+  INPUT_KEY_UP
+} input_event_type_t;
+
+/**
+   One mouse button or key going down or up.
+*/
+typedef struct input_event {
+  input_event_type_t type;
+
+  /** glfw mouse button or key. */
+  int                code;
+
+  /** Mouse position when the event happened. */
+  int                x;
+  int                y;
+
+  /** profile_now() when glfw delivered the event. */
+  double             time;
+} input_event_t;
+
+/**
+   Registers the glfw callbacks.  Needs an open window.
+*/
+void input_init(void);
+
+/**
+   Adds an event to the queue.
+
+   @return
+     False if the queue was full and the event was dropped.
+*/
+bool input_push(const input_event_t* event);
+
+/**
+   Takes the oldest event off the queue.
+
+   @return
+     False if the queue was empty.
+*/
+bool input_pop(input_event_t* event);
+
+/**
+   Gets the number of events dropped because the queue was full.
+*/
+unsigned int input_dropped_count(void);
+
+#endif
@@ -0,0 +1,439 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "util.h"
+#include "profile.h"
+#include "trace.h"
+#include "jobs.h"
+
+typedef struct job {
+  job_func_t       func;
+  /** Set instead of func for a piece of a parallel loop. */
+  job_range_func_t range_func;
+  void*            data;
+  int              start;
+  int              end;
+  int              grain;
+  job_group_t*     group;
+} job_t;
+
+/**
+   One thread's jobs.  The owner works from the bottom, thieves from the
+   top.
+*/
+typedef struct job_deque {
+  pthread_mutex_t lock;
+  job_t           jobs[JOBS_DEQUE_SIZE];
+  unsigned int    top;
+  unsigned int    bottom;
+} job_deque_t;
+
+static struct {
+  bool            enabled;
+
+  pthread_t*      threads;
+  int             thread_count;
+  /** One per thread, the main thread's first. */
+  job_deque_t*    deques;
+
+  /** Jobs sitting in deques.  Idle workers sleep while it's zero. */
+  int             queued;
+  int             sleepers;
+  bool            stopping;
+  pthread_mutex_t sleep_lock;
+  pthread_cond_t  work_ready;
+
+  /** Continuations for the main thread, run from main_head on. */
+  pthread_mutex_t main_lock;
+  job_t*          main_jobs;
+  int             main_head;
+  int             main_count;
+  int             main_capacity;
+} jobs = { .main_lock = PTHREAD_MUTEX_INITIALIZER };
+
+/** 
+    Deque of the current thread.  -1 for threads the job system didn't
+    start, which share the main thread's.
+*/
+static __thread int job_thread = -1;
+
+//==============================================================================
+// Deques
+//==============================================================================
+
+static job_deque_t*
+own_deque(void) {
+  return jobs.deques + (job_thread >= 0 ? job_thread : 0);
+}
+
+static void run_job(job_t* job);
+
+/**
+   Adds a job to the current thread's deque, waking a sleeping worker to
+   take it.
+*/
+static void
+push_job(job_t* job) {
+  job_deque_t* deque = own_deque();
+  bool         full;
+
+  pthread_mutex_lock(&deque->lock);
+  full = deque->bottom - deque->top == JOBS_DEQUE_SIZE;
+  if(!full) {
+    deque->jobs[deque->bottom % JOBS_DEQUE_SIZE] = *job;
+    deque->bottom++;
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  if(full) {
+    run_job(job);
+    return;
+  }
+
+  __atomic_add_fetch(&jobs.queued, 1, __ATOMIC_SEQ_CST);
+
+  if(__atomic_load_n(&jobs.sleepers, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&jobs.sleep_lock);
+    pthread_cond_signal(&jobs.work_ready);
+    pthread_mutex_unlock(&jobs.sleep_lock);
+  }
+}
+
+/**
+   Finds the next job in a deque that belongs to group, searching from the
+   bottom for the owner and from the top for thieves.
+
+   @return
+     Offset of the job from the deque's top, or -1 if there's none.
+*/
+static int
+find_job(job_deque_t* deque, job_group_t* group, bool owner) {
+  int count = deque->bottom - deque->top;
+
+  for(int i = 0; i < count; i++) {
+    int     offset = owner ? count - 1 - i : i;
+    job_t*  job = deque->jobs + (deque->top + offset) % JOBS_DEQUE_SIZE;
+
+    if(group == NULL || job->group == group) {
+      return offset;
+    }
+  }
+
+  return -1;
+}
+
+/**
+   Takes the newest job from the current thread's deque, or failing that
+   steals the oldest from another thread's.
+
+   @param group
+     Only takes jobs from this group, skipping past others, or any job if
+     NULL.  A thread waiting on a group mustn't get stuck in someone else's
+     long job.
+
+   @return
+     False if no deque held a job to take.
+*/
+static bool
+take_job(job_t* job, job_group_t* group) {
+  int  own = job_thread >= 0 ? job_thread : 0;
+  bool found = false;
+
+  for(int i = 0; i <= jobs.thread_count && !found; i++) {
+    job_deque_t* deque = jobs.deques + (own + i) % (jobs.thread_count + 1);
+    int          offset;
+
+    pthread_mutex_lock(&deque->lock);
+    offset = find_job(deque, group, i == 0);
+    if(offset >= 0) {
+      unsigned int index = deque->top + offset;
+
+      *job = deque->jobs[index % JOBS_DEQUE_SIZE];
+
+      // Close the gap, keeping the rest in order.
+      for(; index + 1 != deque->bottom; index++) {
+        deque->jobs[index % JOBS_DEQUE_SIZE] =
+          deque->jobs[(index + 1) % JOBS_DEQUE_SIZE];
+      }
+      deque->bottom--;
+      found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+  }
+
+  if(found) {
+    __atomic_sub_fetch(&jobs.queued, 1, __ATOMIC_SEQ_CST);
+  }
+
+  return found;
+}
+
+static void
+run_job(job_t* job) {
+  trace_begin("job");
+
+  if(job->range_func != NULL) {
+    // Hand the top halves of the range out for other threads to steal.
+    while(job->end - job->start > job->grain) {
+      job_t half = *job;
+
+      half.start = job->start + (job->end - job->start) / 2;
+      job->end = half.start;
+
+      __atomic_add_fetch(&job->group->pending, 1, __ATOMIC_RELAXED);
+      push_job(&half);
+    }
+
+    job->range_func(job->data, job->start, job->end);
+  } else {
+    job->func(job->data);
+  }
+
+  trace_end("job");
+
+  if(job->group != NULL) {
+    __atomic_sub_fetch(&job->group->pending, 1, __ATOMIC_RELEASE);
+  }
+}
+
+static void*
+run_worker(void* data) {
+  job_t job;
+
+  job_thread = (int)(size_t)data;
+  trace_thread_name("job worker");
+
+  while(true) {
+    bool stop;
+
+    if(take_job(&job, NULL)) {
+      run_job(&job);
+      continue;
+    }
+
+    pthread_mutex_lock(&jobs.sleep_lock);
+    __atomic_add_fetch(&jobs.sleepers, 1, __ATOMIC_SEQ_CST);
+
+    while(!jobs.stopping &&
+          __atomic_load_n(&jobs.queued, __ATOMIC_SEQ_CST) == 0)
+    {
+      pthread_cond_wait(&jobs.work_ready, &jobs.sleep_lock);
+    }
+
+    __atomic_sub_fetch(&jobs.sleepers, 1, __ATOMIC_SEQ_CST);
+    stop = jobs.stopping &&
+      __atomic_load_n(&jobs.queued, __ATOMIC_SEQ_CST) == 0;
+    pthread_mutex_unlock(&jobs.sleep_lock);
+
+    if(stop) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+//==============================================================================
+// Public
+//==============================================================================
+
+bool
+jobs_init(int thread_count) {
+  if(thread_count <= 0) {
+    return true;
+  }
+
+  jobs.deques = new_array(job_deque_t, thread_count + 1);
+  jobs.threads = new_array(pthread_t, thread_count);
+
+  pthread_mutex_init(&jobs.sleep_lock, NULL);
+  pthread_cond_init(&jobs.work_ready, NULL);
+
+  for(int i = 0; i <= thread_count; i++) {
+    pthread_mutex_init(&jobs.deques[i].lock, NULL);
+  }
+
+  job_thread = 0;
+  jobs.stopping = false;
+
+  for(int i = 0; i < thread_count; i++) {
+    if(pthread_create(jobs.threads + i, NULL, run_worker,
+                      (void*)(size_t)(i + 1)) != 0)
+    {
+      logmsg("Unable to start job thread %d.", i + 1);
+      break;
+    }
+
+    jobs.thread_count++;
+  }
+
+  jobs.enabled = jobs.thread_count > 0;
+  return jobs.thread_count == thread_count;
+}
+
+void
+jobs_shutdown(void) {
+  job_t job;
+
+  if(jobs.deques != NULL) {
+    while(take_job(&job, NULL)) {
+      run_job(&job);
+    }
+
+    pthread_mutex_lock(&jobs.sleep_lock);
+    jobs.stopping = true;
+    pthread_cond_broadcast(&jobs.work_ready);
+    pthread_mutex_unlock(&jobs.sleep_lock);
+
+    for(int i = 0; i < jobs.thread_count; i++) {
+      pthread_join(jobs.threads[i], NULL);
+    }
+
+    jobs.enabled = false;
+  }
+
+  jobs_run_main(0);
+
+  if(jobs.deques != NULL) {
+    for(int i = 0; i <= jobs.thread_count; i++) {
+      pthread_mutex_destroy(&jobs.deques[i].lock);
+    }
+
+    pthread_cond_destroy(&jobs.work_ready);
+    pthread_mutex_destroy(&jobs.sleep_lock);
+
+    delete(jobs.deques);
+    delete(jobs.threads);
+    jobs.thread_count = 0;
+  }
+
+  delete(jobs.main_jobs);
+  jobs.main_capacity = 0;
+}
+
+void
+jobs_run(job_group_t* group, job_func_t func, void* data) {
+  job_t job = { func, NULL, data, 0, 0, 0, group };
+
+  if(group != NULL) {
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+  }
+
+  if(jobs.enabled) {
+    push_job(&job);
+  } else {
+    run_job(&job);
+  }
+}
+
+void
+jobs_wait(job_group_t* group) {
+  while(__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+    job_t job;
+
+    if(jobs.enabled && take_job(&job, group)) {
+      run_job(&job);
+    } else {
+      // What's left is running on other threads.
+      sched_yield();
+    }
+  }
+}
+
+void
+jobs_parallel_for(job_range_func_t func, void* data, int count, int grain) {
+  job_group_t group = { 1 };
+  job_t       job = { NULL, func, data, 0, count, max(grain, 1), &group };
+
+  if(count <= 0) {
+    return;
+  }
+
+  if(!jobs.enabled) {
+    func(data, 0, count);
+    return;
+  }
+
+  run_job(&job);
+  jobs_wait(&group);
+}
+
+void
+jobs_run_on_main(job_func_t func, void* data) {
+  job_t job = { func, NULL, data, 0, 0, 0, NULL };
+
+  pthread_mutex_lock(&jobs.main_lock);
+
+  if(jobs.main_count == jobs.main_capacity) {
+    jobs.main_capacity = max(jobs.main_capacity * 2, 16);
+    jobs.main_jobs = realloc(jobs.main_jobs,
+                             jobs.main_capacity * sizeof(job_t));
+    if(jobs.main_jobs == NULL) {
+      logmsg("Unable to grow the main thread queue.");
+      exit(1);
+    }
+  }
+
+  jobs.main_jobs[jobs.main_count++] = job;
+
+  pthread_mutex_unlock(&jobs.main_lock);
+}
+
+int
+jobs_run_main(double budget) {
+  double start = profile_now();
+  int    run = 0;
+
+  do {
+    job_t job;
+    bool  found = false;
+
+    pthread_mutex_lock(&jobs.main_lock);
+    if(jobs.main_head < jobs.main_count) {
+      job = jobs.main_jobs[jobs.main_head++];
+      found = true;
+    }
+
+    if(jobs.main_head == jobs.main_count) {
+      jobs.main_head = 0;
+      jobs.main_count = 0;
+    }
+    pthread_mutex_unlock(&jobs.main_lock);
+
+    if(!found) {
+      break;
+    }
+
+    job.func(job.data);
+    run++;
+  } while(budget <= 0 || profile_now() - start < budget);
+
+  return run;
+}
+
+int
+jobs_thread_count(void) {
+  return jobs.thread_count + 1;
+}
+
+int
+jobs_core_count(void) {
+#ifdef WIN32
+  SYSTEM_INFO info;
+
+  GetSystemInfo(&info);
+  return max(info.dwNumberOfProcessors, 1);
+#else
+  return max(sysconf(_SC_NPROCESSORS_ONLN), 1);
+#endif
+}
@@ -0,0 +1,106 @@
+/**
+   @file jobs.h
+
+   The job system everything that runs in parallel shares: texture decoding
+   and compression, board updates and the command line solvers.  Each
+   thread keeps its own deque of jobs, pushing and popping at one end while
+   idle threads steal from the other.  Jobs can be counted in groups and
+   waited on, and a thread waiting on a group runs jobs until it's done, so
+   jobs may start and wait on jobs of their own.
+
+   GL calls have to stay on the main thread, so jobs can queue continuations
+   that run when the main thread calls jobs_run_main.
+
+   Until jobs_init is called, or when it's given no threads, jobs run
+   straight away on the thread starting them.
+*/
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+/** Jobs one thread's deque holds.  Jobs pushed to a full deque run inline. */
+#define JOBS_DEQUE_SIZE 1024
+
+typedef void (*job_func_t)(void* data);
+
+/**
+   Work done for the indices [start, end) of a parallel loop.
+*/
+typedef void (*job_range_func_t)(void* data, int start, int end);
+
+/**
+   Counts jobs that haven't finished.  Zero it before use.
+*/
+typedef struct job_group {
+  int pending;
+} job_group_t;
+
+/**
+   Starts the worker threads.  The calling thread becomes the main thread.
+
+   @param thread_count
+     Workers to start, besides the main thread.
+   @return
+     False if the workers couldn't be started.  Jobs then run inline.
+*/
+bool jobs_init(int thread_count);
+
+/**
+   Runs every job still queued, then any continuations left for the main
+   thread, and stops the workers.
+*/
+void jobs_shutdown(void);
+
+/**
+   Queues func(data).
+
+   @param group
+     Counts the job until it finishes.  May be NULL.
+*/
+void jobs_run(job_group_t* group, job_func_t func, void* data);
+
+/**
+   Runs the group's queued jobs until every job in it has finished.  Jobs
+   from other groups are left to the workers, so waiting on a short group
+   never picks up an unrelated long one.
+*/
+void jobs_wait(job_group_t* group);
+
+/**
+   Runs func over [0, count) spread across the threads and waits for it.
+   The range is split in halves until pieces are no bigger than grain, so
+   idle threads steal large pieces first.
+*/
+void jobs_parallel_for(job_range_func_t func, void* data, int count,
+                       int grain);
+
+/**
+   Queues func(data) to run on the main thread.  Safe from any thread.
+*/
+void jobs_run_on_main(job_func_t func, void* data);
+
+/**
+   Runs continuations queued for the main thread, oldest first, until none
+   are left or the time budget is spent.  At least one runs if any are
+   queued.  Only call from the main thread.
+
+   @param budget
+     Seconds to spend.  0 runs everything queued.
+   @return
+     Number of continuations run.
+*/
+int jobs_run_main(double budget);
+
+/**
+   Gets the number of threads jobs are spread over, the main thread
+   included.
+*/
+int jobs_thread_count(void);
+
+/**
+   Gets the number of processor cores, for sizing the workers.
+*/
+int jobs_core_count(void);
+
+#endif
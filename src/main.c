@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <GL/glfw.h>
@@ -7,10 +8,70 @@
 #include "geo.h"
 #include "util.h"
 #include "game.h"
+#include "grid.h"
+#include "input.h"
+#include "jobs.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+   How long the main loop sleeps between input checks when nothing on screen
+   is changing.
+*/
+const double IDLE_POLL_INTERVAL = 1.0 / 60.0;
+
+/**
+   Seconds each pass of the main loop may spend on work jobs handed back to
+   the main thread, such as uploading textures that finished loading.
+*/
+const double MAIN_JOB_BUDGET = 0.004;
+
+/** Images packed into the ui atlas, indexed by ui_image_t. */
+typedef enum ui_image {
+  UI_IMAGE_DIGITS,
+  UI_IMAGE_HUD_WORDS,
+  UI_IMAGE_MENU_FONT,
+  UI_IMAGE_COUNT
+} ui_image_t;
+
+const char* UI_IMAGES[UI_IMAGE_COUNT] = {
+  "data/digits.png",
+  "data/hud-words.png",
+  "data/menu-font.png"
+};
+
+/** Time the game is moved on by per frame when there is no window. */
+const double HEADLESS_FRAME_TIME = 1.0 / 60.0;
+
+/** Frames drawn by the software renderer if no limit is given. */
+const int    HEADLESS_DEFAULT_FRAMES = 60;
 
 app_data_t   app_data;
 game_t*      game;
 
+/** Boards being spectated, or NULL when playing a single game. */
+grid_t*      grid;
+int          board_count = 0;
+
+/** Set when the window has to be redrawn even if the game didn't change. */
+bool         window_damaged = true;
+
+/** Number of frames to draw before quitting, or 0 to run until closed. */
+int          frame_limit = 0;
+int          frames_rendered = 0;
+
+/** File the last frame is saved to, if any. */
+char*        screenshot_filename = NULL;
+
+/** File a trace of the run is written to on exit, if any. */
+char*        trace_filename = NULL;
+
+/** Game logic steps per second. */
+int          update_rate = 0;
+
+/** Whether frame timings are drawn over the game.  Toggled with F3. */
+bool         show_profile = false;
+
 /**
    Translates a command-line argument flag to a skill level.
 */
@@ -31,60 +92,343 @@ skill_flag_to_level(int flag) {
   return skill;
 }
 
+/**
+   Translates a command-line renderer name to a renderer.
+*/
+gfx_renderer_t
+renderer_name_to_renderer(const char* name) {
+  gfx_renderer_t renderer = GFX_RENDERER_LEGACY;
+
+  if(strcmp(name, "gl3") == 0) {
+    renderer = GFX_RENDERER_GL3;
+  } else if(strcmp(name, "software") == 0) {
+    renderer = GFX_RENDERER_SOFTWARE;
+  } else if(strcmp(name, "legacy") != 0) {
+    printf("Unknown renderer %s.  Defaulting to legacy.\n", name);
+  }
+
+  return renderer;
+}
+
 bool
-init_game(char* image_filename, skill_level_t skill) {
+init_game(char* image_filename, skill_level_t skill, gfx_renderer_t renderer) {
   bool result;
-  texture_t* digits_texture;
   texture_t* game_image;
  
   log_init("game.log");
-  result = gfx_init("Sliding Tile Game", SCREEN_WIDTH, SCREEN_HEIGHT);
+  result = gfx_init("Sliding Tile Game", SCREEN_WIDTH, SCREEN_HEIGHT, 
+                    renderer);
 
   if(result) {
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     gfx_begin_2d();
 
-    game_image = texture_load(image_filename, true);
+    // Decoded in the background.  The board shows placeholder tiles until
+    // the picture is uploaded.
+    game_image = texture_request(image_filename, true);
     if(game_image == NULL) {
       printf("Cannot load image %s\n", image_filename);
       result = false;
     } else {
-      game = game_new(skill, game_image);
+      if(board_count > 0) {
+        grid = grid_new(board_count, skill, game_image);
 
-      digits_texture = texture_load("data/digits.png", true);
-      app_data.digits = sprite_sheet_new(digits_texture, 16, 24);
-      app_data.hud_words = texture_load("data/hud-words.png", true);
+        for(int i = 0; i < grid->count && update_rate > 0; i++) {
+          grid->games[i]->step_length = 1.0 / update_rate;
+        }
+      } else {
+        game = game_new(skill, game_image);
+        if(update_rate > 0) {
+          game->step_length = 1.0 / update_rate;
+        }
+      }
+
+      // The hud and fonts share one texture so they batch together.
+      app_data.ui_atlas = atlas_load(UI_IMAGES, UI_IMAGE_COUNT, true);
+      if(app_data.ui_atlas == NULL) {
+        printf("Cannot load the hud images\n");
+        result = false;
+      } else {
+        texture_t* texture = app_data.ui_atlas->texture;
+        rect_t*    areas = app_data.ui_atlas->areas;
+
+        app_data.digits = sprite_sheet_new_from_area(texture,
+                                                     &areas[UI_IMAGE_DIGITS],
+                                                     16, 24);
+        sprite_set(&app_data.hud_words, texture, &areas[UI_IMAGE_HUD_WORDS]);
+        app_data.menu_font = font_new_from_area(texture,
+                                                &areas[UI_IMAGE_MENU_FONT],
+                                                16, 16);
+        app_data.hud = quad_run_new(texture, 32);
+      }
     }
   }
 
   return result;
 }
 
+/**
+   Called by glfw when the window contents are lost (uncovered, restored and
+   so forth).
+*/
+void GLFWCALL
+on_window_refresh(void) {
+  window_damaged = true;
+}
+
+/**
+   Waits until there may be something new to draw.  A finished game with
+   its textures in never changes on its own so it waits for window events.
+   Otherwise it sleeps a short while so the clock, input and texture
+   uploads keep going without spinning.
+*/
+void
+wait_for_change(void) {
+  if(game != NULL && game->play_state == PLAY_STATE_GAME_FINISHED &&
+     texture_pending_count() == 0)
+  {
+    glfwWaitEvents();
+  } else {
+    glfwSleep(IDLE_POLL_INTERVAL);
+
+    profile_begin(PROFILE_INPUT);
+    glfwPollEvents();
+    profile_end(PROFILE_INPUT);
+  }
+}
+
+/**
+   Draws the rolling frame timings in the upper left-hand corner.
+*/
+void
+draw_profile_overlay(void) {
+  color_t background = { 0, 0, 0, 192 };
+  color_t text_color = { 255, 255, 0, 255 };
+  int     line_height = app_data.menu_font->sheet->sprite_height + 2;
+  rect_t  area = { 8, 40, 0, 0 };
+  char    line[32];
+  double  average, p99;
+
+  area.width = 26 * app_data.menu_font->sheet->sprite_width + 8;
+  area.height = (PROFILE_PHASE_COUNT + 3) * line_height + 4;
+  gfx_draw_rect(&area, &background, true);
+
+  font_render_string(app_data.menu_font, area.x + 4, area.y + 4,
+                     "phase     avg ms    p99 ms", &text_color);
+
+  for(int phase = 0; phase <= PROFILE_PHASE_COUNT; phase++) {
+    profile_get_stats(phase, &average, &p99);
+    snprintf(line, sizeof(line), "%-7s %8.3f  %8.3f", 
+             profile_phase_name(phase), average, p99);
+
+    font_render_string(app_data.menu_font, area.x + 4,
+                       area.y + 4 + (phase + 1) * line_height, line,
+                       &text_color);
+  }
+
+  // Click to move latency, once there has been a move.
+  if(profile_get_latency(&average, &p99)) {
+    snprintf(line, sizeof(line), "%-7s %8.3f  %8.3f", "latency", average,
+             p99);
+    font_render_string(app_data.menu_font, area.x + 4,
+                       area.y + 4 + (PROFILE_PHASE_COUNT + 2) * line_height,
+                       line, &text_color);
+  }
+}
+
+/**
+   Draws the game and presents it.  If a screenshot was asked for, the
+   frame that reaches the frame limit is saved first.
+*/
+void
+render_frame(void) {
+  color_t     background = COLOR_BLACK;
+  gfx_stats_t stats;
+
+  profile_begin(PROFILE_RENDER);
+  gfx_clear(&background);
+
+  trace_begin("game_render");
+  if(grid != NULL) {
+    grid_render(grid);
+  } else {
+    game_render(&app_data, game);
+  }
+  trace_end("game_render");
+
+  if(show_profile) {
+    draw_profile_overlay();
+  }
+  profile_end(PROFILE_RENDER);
+
+  frames_rendered++;
+
+  if(screenshot_filename != NULL && frames_rendered == frame_limit) {
+    gfx_save_frame(screenshot_filename);
+  }
+
+  profile_begin(PROFILE_SWAP);
+  gfx_swap_buffers();
+  profile_end(PROFILE_SWAP);
+
+  // Click to photon, as near as the program can see it: the first swapped
+  // frame with the clicked tiles moved.
+  if(game != NULL && game->input_shown) {
+    double latency = profile_now() - game->input_time;
+
+    profile_add_latency(latency);
+    trace_counter("input_latency_ms", latency * 1000.0);
+    game->input_time = 0.0;
+    game->input_shown = false;
+  }
+
+  gfx_get_frame_stats(&stats);
+  trace_counter("quads", stats.quads);
+  trace_counter("draw_calls", stats.draw_calls);
+}
+
+/**
+   Moves the game, or every spectated board, on by some time.
+*/
+void
+update_frame(double delta) {
+  profile_begin(PROFILE_UPDATE);
+  if(grid != NULL) {
+    grid_update(grid, delta);
+  } else {
+    game_update(game, delta);
+  }
+  profile_end(PROFILE_UPDATE);
+}
+
+/**
+   Prints the frame timings, for runs without a window to draw them in.
+*/
+void
+print_profile(void) {
+  for(int phase = 0; phase <= PROFILE_PHASE_COUNT; phase++) {
+    double average, p99;
+
+    profile_get_stats(phase, &average, &p99);
+    printf("%-7s %8.3f ms average, %8.3f ms p99\n", 
+           profile_phase_name(phase), average, p99);
+  }
+}
+
+/**
+   Runs the game without a window.  The game is moved on by a fixed time
+   each frame, so the frames drawn are the same on every run.
+*/
+void
+headless_loop(void) {
+  double start_time;
+  double elapsed;
+
+  // Every run has to draw the same frames, so nothing is drawn before the
+  // textures are in.
+  texture_finish_loads();
+  start_time = gfx_get_time();
+
+  while(frames_rendered < frame_limit) {
+    update_frame(HEADLESS_FRAME_TIME);
+    render_frame();
+    profile_end_frame();
+  }
+
+  elapsed = gfx_get_time() - start_time;
+  printf("%d frames in %.3f s, %.1f frames/s\n", frames_rendered, elapsed,
+         elapsed > 0.0 ? frames_rendered / elapsed : 0.0);
+  print_profile();
+}
+
+/**
+   Acts on the input events glfw queued since the last pass.  Clicks that
+   start a move leave their time on the game, so render_frame can record
+   the latency once they are drawn.
+
+   @return
+     False once the player asked to quit.
+*/
+bool
+handle_input(void) {
+  input_event_t event;
+  bool          running = true;
+
+  while(input_pop(&event)) {
+    if(event.type == INPUT_MOUSE_DOWN && 
+       event.code == GLFW_MOUSE_BUTTON_LEFT && game != NULL) 
+    {
+      if(game_on_click(game, event.x, event.y)) {
+        game->input_time = event.time;
+        game->input_shown = false;
+      }
+    } else if(event.type == INPUT_KEY_DOWN && event.code == GLFW_KEY_F3) {
+      show_profile = !show_profile;
+      window_damaged = true;
+    } else if(event.type == INPUT_KEY_DOWN && event.code == GLFW_KEY_ESC) {
+      running = false;
+    }
+  }
+
+  return running;
+}
+
 void
 main_loop(void) {
-  bool running = true;
+  bool   running = true;
   double current_time = 0.0;
+  double last_update_time;
+
+  glfwSetWindowRefreshCallback(on_window_refresh);
+  input_init();
+
+  if(screenshot_filename != NULL) {
+    texture_finish_loads();
+  }
+
+  // Loading isn't play time, and the first step shouldn't make up for it.
+  last_update_time = gfx_get_time();
 
   while(running) {
-    glClear(GL_COLOR_BUFFER_BIT);
-    game_render(&app_data, game);
-    glfwSwapBuffers();
+    bool rendered = false;
+
+    if(jobs_run_main(MAIN_JOB_BUDGET) > 0) {
+      window_damaged = true;
+    }
 
-    if(glfwGetMouseButton(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-      int x, y;
+    // Frames are only produced when something visible changed.  Spectated
+    // boards are always moving.
+    if(window_damaged || grid != NULL || game_needs_render(game)) {
+      render_frame();
 
-      glfwGetMousePos(&x, &y);
-      game_on_click(game, x, y);
+      window_damaged = false;
+      rendered = true;
+    } else {
+      wait_for_change();
     }
 
-    current_time = glfwGetTime();
+    profile_begin(PROFILE_INPUT);
+    running = handle_input();
+    profile_end(PROFILE_INPUT);
+
+    // The game steps at its own rate however long this pass took.
+    current_time = gfx_get_time();
 
-    if(current_time - game->last_update_time >= (32.0 / 1000.0)) {
-      game_update(game, current_time - game->last_update_time);
-      game->last_update_time = current_time;
+    update_frame(current_time - last_update_time);
+    last_update_time = current_time;
+
+    // A profile row holds one pass through the loop that drew a frame.
+    if(rendered) {
+      profile_end_frame();
+    } else {
+      profile_discard_frame();
     }
 
-    running = !glfwGetKey(GLFW_KEY_ESC) && glfwGetWindowParam(GLFW_OPENED);
+    running = running && glfwGetWindowParam(GLFW_OPENED) &&
+      (frame_limit == 0 || frames_rendered < frame_limit);
+  }
+
+  if(input_dropped_count() > 0) {
+    logmsg("Dropped %u input events on a full queue.", input_dropped_count());
   }
 }
 
@@ -92,7 +436,17 @@ void
 shutdown_game(void) {
   if(game != NULL) {
     game_end(game);
+  }
+
+  if(grid != NULL) {
+    grid_delete(grid);
+  }
+
+  if(app_data.ui_atlas != NULL) {
+    quad_run_delete(app_data.hud);
+    font_delete(app_data.menu_font);
     sprite_sheet_delete(app_data.digits);
+    atlas_delete(app_data.ui_atlas);
   }
 
   gfx_end_2d();
@@ -106,29 +460,86 @@ void print_usage() {
     "\n"
     "Options:\n"
     "\t--(s)kill [e|m|h]     Chooses a difficulty.  Easy, Medium and Hard.\n"
-    "\t--(i)mage [filename]  Selects the image to use.\n";
+    "\t--(i)mage [filename]  Selects the image to use.\n"
+    "\t--(r)enderer [legacy|gl3|software]\n"
+    "\t                      Chooses the fixed function, opengl 3.3 or "
+    "headless\n"
+    "\t                      software renderer.\n"
+    "\t--(f)rames [count]    Quits after drawing count frames.\n"
+    "\t--scree(n)shot [filename]\n"
+    "\t                      Saves the last frame to a BMP file.\n"
+    "\t--(t)race [filename]  Writes a chrome trace of the run to filename.\n"
+    "\t--(u)pdate-rate [rate]\n"
+    "\t                      Steps the game logic rate times a second.\n"
+    "\t--(b)oards [count]    Spectates count computer played boards at "
+    "once.\n";
 
   printf(usage);
 }
 
 int main(int argc, char** argv) {
-  char* img_name = "default.jpg";
-  int   skill_flag = 'e';
-  bool  should_run = true;
+  char*          img_name = "default.jpg";
+  char*          renderer_name = "legacy";
+  int            skill_flag = 'e';
+  bool           should_run = true;
+  gfx_renderer_t renderer;
 
   // Process command line args
   for(int i = 1; i < argc; i++) {
     if((strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--skill") == 0)
-       && argc >= (i + 1)) 
+       && argc > (i + 1)) 
     {
       skill_flag = argv[i + 1][0];
       i++;
     }
 
-    else if((strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--image"))
-            && argc >= (i + 1)) 
+    else if((strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--image") == 0)
+            && argc > (i + 1)) 
     {
       img_name = argv[i + 1];
+      i++;
+    }
+
+    else if((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--renderer") == 0)
+            && argc > (i + 1)) 
+    {
+      renderer_name = argv[i + 1];
+      i++;
+    }
+
+    else if((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--frames") == 0)
+            && argc > (i + 1)) 
+    {
+      frame_limit = atoi(argv[i + 1]);
+      i++;
+    }
+
+    else if((strcmp(argv[i], "-n") == 0 || 
+             strcmp(argv[i], "--screenshot") == 0) && argc > (i + 1)) 
+    {
+      screenshot_filename = argv[i + 1];
+      i++;
+    }
+
+    else if((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--trace") == 0)
+            && argc > (i + 1)) 
+    {
+      trace_filename = argv[i + 1];
+      i++;
+    }
+
+    else if((strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--boards") == 0)
+            && argc > (i + 1)) 
+    {
+      board_count = atoi(argv[i + 1]);
+      i++;
+    }
+
+    else if((strcmp(argv[i], "-u") == 0 || 
+             strcmp(argv[i], "--update-rate") == 0) && argc > (i + 1)) 
+    {
+      update_rate = atoi(argv[i + 1]);
+      i++;
     }
 
     else {
@@ -137,11 +548,38 @@ int main(int argc, char** argv) {
     }
   }
 
-  if(should_run && init_game(img_name, skill_flag_to_level(skill_flag))) {
-    main_loop();
+  renderer = renderer_name_to_renderer(renderer_name);
+
+  // Started before init so texture loading shows up in the trace.
+  if(should_run && trace_filename != NULL) {
+    trace_init(trace_filename);
+    trace_thread_name("main");
+  }
+
+  // Without a window there is nothing else to stop on.
+  if(frame_limit <= 0 && 
+     (renderer == GFX_RENDERER_SOFTWARE || screenshot_filename != NULL)) 
+  {
+    frame_limit = HEADLESS_DEFAULT_FRAMES;
+  }
+
+  if(should_run) {
+    jobs_init(jobs_core_count() - 1);
+  }
+
+  if(should_run && init_game(img_name, skill_flag_to_level(skill_flag),
+                             renderer)) 
+  {
+    if(renderer == GFX_RENDERER_SOFTWARE) {
+      headless_loop();
+    } else {
+      main_loop();
+    }
   }
 
   shutdown_game();
+  jobs_shutdown();
+  trace_shutdown();
 
   return 0;
 }
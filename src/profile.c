@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "profile.h"
+#include "trace.h"
+
+static const char* PHASE_NAMES[PROFILE_PHASE_COUNT + 1] = {
+  "input",
+  "update",
+  "render",
+  "swap",
+  "frame"
+};
+
+static struct {
+  /** Seconds spent in each phase, one row per recent frame. */
+  double samples[PROFILE_FRAMES][PROFILE_PHASE_COUNT];
+
+  /** Row the current frame is added up in. */
+  int    frame;
+  /** Number of rows holding complete frames, all but the current one. */
+  int    frame_count;
+
+  /** When each running phase began. */
+  double started[PROFILE_PHASE_COUNT];
+
+  /** Recent input latencies in seconds, oldest overwritten first. */
+  double latencies[PROFILE_FRAMES];
+  int    latency_count;
+  int    latency_next;
+} profile;
+
+double
+profile_now(void) {
+#ifdef WIN32
+  LARGE_INTEGER counter, frequency;
+
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void
+profile_begin(profile_phase_t phase) {
+  trace_begin(PHASE_NAMES[phase]);
+  profile.started[phase] = profile_now();
+}
+
+void
+profile_end(profile_phase_t phase) {
+  profile.samples[profile.frame][phase] +=
+    profile_now() - profile.started[phase];
+  trace_end(PHASE_NAMES[phase]);
+}
+
+void
+profile_end_frame(void) {
+  profile.frame = (profile.frame + 1) % PROFILE_FRAMES;
+  if(profile.frame_count < PROFILE_FRAMES - 1) {
+    profile.frame_count++;
+  }
+
+  profile_discard_frame();
+}
+
+void
+profile_discard_frame(void) {
+  memset(profile.samples[profile.frame], 0,
+         sizeof(profile.samples[profile.frame]));
+}
+
+static int
+compare_doubles(const void* a, const void* b) {
+  double left = *(const double*)a;
+  double right = *(const double*)b;
+
+  return (left > right) - (left < right);
+}
+
+/**
+   Fills in the mean and 99th percentile of some times, in milliseconds.
+   The times are sorted in place.
+*/
+static void
+get_stats(double* times, int count, double* average, double* p99) {
+  double total = 0.0;
+
+  *average = 0.0;
+  *p99 = 0.0;
+
+  if(count > 0) {
+    for(int i = 0; i < count; i++) {
+      total += times[i];
+    }
+
+    qsort(times, count, sizeof(double), compare_doubles);
+
+    *average = total * 1000.0 / count;
+    *p99 = times[(count - 1) * 99 / 100] * 1000.0;
+  }
+}
+
+void
+profile_get_stats(profile_phase_t phase, double* average, double* p99) {
+  double times[PROFILE_FRAMES];
+  int    count = profile.frame_count;
+
+  // The current row is still being added up so it's left out.
+  for(int i = 0; i < count; i++) {
+    int row = (profile.frame + PROFILE_FRAMES - 1 - i) % PROFILE_FRAMES;
+
+    times[i] = 0.0;
+    for(int p = 0; p < PROFILE_PHASE_COUNT; p++) {
+      if(p == phase || phase == PROFILE_PHASE_COUNT) {
+        times[i] += profile.samples[row][p];
+      }
+    }
+  }
+
+  get_stats(times, count, average, p99);
+}
+
+void
+profile_add_latency(double seconds) {
+  profile.latencies[profile.latency_next] = seconds;
+  profile.latency_next = (profile.latency_next + 1) % PROFILE_FRAMES;
+
+  if(profile.latency_count < PROFILE_FRAMES) {
+    profile.latency_count++;
+  }
+}
+
+bool
+profile_get_latency(double* average, double* p99) {
+  double times[PROFILE_FRAMES];
+
+  memcpy(times, profile.latencies, sizeof(times));
+  get_stats(times, profile.latency_count, average, p99);
+
+  return profile.latency_count > 0;
+}
+
+const char*
+profile_phase_name(profile_phase_t phase) {
+  return PHASE_NAMES[phase];
+}
@@ -0,0 +1,93 @@
+/**
+   @file profile.h
+
+   Times the phases of each frame.  Samples go into a fixed ring of recent
+   frames, so profiling never allocates and costs a couple of clock reads
+   per phase.  Phases are also recorded as trace spans when tracing is on.
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+
+/** Number of recent frames statistics are taken over. */
+#define PROFILE_FRAMES 256
+
+/**
+   Parts of a frame that are timed.
+*/
+typedef enum profile_phase {
+  PROFILE_INPUT,
+  PROFILE_UPDATE,
+  PROFILE_RENDER,
+  PROFILE_SWAP,
+
+  /** Number of phases.  Also stands for the whole frame in statistics. */
+  PROFILE_PHASE_COUNT
+} profile_phase_t;
+
+/**
+   Gets the time in seconds from a monotonic, high resolution clock.
+*/
+double profile_now(void);
+
+/**
+   Starts timing a phase.  A phase may run several times in one frame; the
+   times are added up.
+*/
+void profile_begin(profile_phase_t phase);
+
+/**
+   Stops timing a phase.
+*/
+void profile_end(profile_phase_t phase);
+
+/**
+   Stores the current frame's times in the ring and starts a new frame.
+*/
+void profile_end_frame(void);
+
+/**
+   Throws away the times added up since the last frame ended, for passes
+   that didn't draw anything.  Otherwise idle time would be charged to the
+   next frame drawn.
+*/
+void profile_discard_frame(void);
+
+/**
+   Gets statistics over the recent frames.
+
+   @param phase
+     Phase to get statistics for or PROFILE_PHASE_COUNT for the sum of all
+     of them.
+   @param average
+     Filled in with the mean time in milliseconds.
+   @param p99
+     Filled in with the 99th percentile time in milliseconds.
+*/
+void profile_get_stats(profile_phase_t phase, double* average, double* p99);
+
+/**
+   Records how long an input event took to show on screen.  The most
+   recent PROFILE_FRAMES samples are kept.
+
+   @param seconds
+     Time from the event to the buffer swap of the first frame drawing
+     its effect.
+*/
+void profile_add_latency(double seconds);
+
+/**
+   Gets statistics over the recent input latencies, as profile_get_stats.
+
+   @return
+     False if no latencies have been recorded yet.
+*/
+bool profile_get_latency(double* average, double* p99);
+
+/**
+   Gets a short name for a phase, or "frame" for PROFILE_PHASE_COUNT.
+*/
+const char* profile_phase_name(profile_phase_t phase);
+
+#endif
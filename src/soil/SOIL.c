@@ -34,12 +34,13 @@
 #include "stb_image_aug.h"
 #include "image_helper.h"
 #include "image_DXT.h"
+#include "../trace.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-/*	error reporting	*/
-char *result_string_pointer = "SOIL initialized";
+/*	error reporting, per thread since images are decoded on worker threads	*/
+static __thread char *result_string_pointer = "SOIL initialized";
 
 /*	for loading cube maps	*/
 enum{
@@ -1116,9 +1117,11 @@ unsigned int
 		{
 			/*	yep, resize	*/
 			unsigned char *resampled = (unsigned char*)malloc( channels*new_width*new_height );
+			trace_begin( "soil_rescale" );
 			up_scale_image(
 					img, width, height, channels,
 					resampled, new_width, new_height );
+			trace_end( "soil_rescale" );
 			/*	OJO	this is for debug only!	*/
 			/*
 			SOIL_save_image( "\\showme.bmp", SOIL_SAVE_TYPE_BMP,
@@ -1224,6 +1227,7 @@ unsigned int
 			/*	user wants me to do the DXT conversion!	*/
 			int DDS_size;
 			unsigned char *DDS_data = NULL;
+			trace_begin( "soil_dxt" );
 			if( (channels & 1) == 1 )
 			{
 				/*	RGB, use DXT1	*/
@@ -1233,6 +1237,7 @@ unsigned int
 				/*	RGBA, use DXT5	*/
 				DDS_data = convert_image_to_DXT5( img, width, height, channels, &DDS_size );
 			}
+			trace_end( "soil_dxt" );
 			if( DDS_data )
 			{
 				soilGlCompressedTexImage2D(
@@ -1282,6 +1287,7 @@ unsigned int
 					/*	user wants me to do the DXT conversion!	*/
 					int DDS_size;
 					unsigned char *DDS_data = NULL;
+					trace_begin( "soil_dxt" );
 					if( (channels & 1) == 1 )
 					{
 						/*	RGB, use DXT1	*/
@@ -1293,6 +1299,7 @@ unsigned int
 						DDS_data = convert_image_to_DXT5(
 								resampled, MIPwidth, MIPheight, channels, &DDS_size );
 					}
+					trace_end( "soil_dxt" );
 					if( DDS_data )
 					{
 						soilGlCompressedTexImage2D(
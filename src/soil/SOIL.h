@@ -421,7 +421,8 @@ void
 /**
 	This function resturn a pointer to a string describing the last thing
 	that happened inside SOIL.  It can be used to determine why an image
-	failed to load.
+	failed to load.  Each thread has its own, so read it on the thread that
+	made the call.
 **/
 const char*
 	SOIL_last_result
@@ -8,6 +8,7 @@
 */
 
 #include "image_DXT.h"
+#include "../jobs.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +20,9 @@
 	method fails for finding the largest eigenvector	*/
 #define USE_COV_MAT	1
 
+/*	block rows (4 pixels high) each job compresses at least	*/
+#define DXT_ROWS_PER_JOB	8
+
 /********* Function Prototypes *********/
 /*
 	Takes a 4x4 block of pixels and compresses it into 8 bytes
@@ -98,36 +102,29 @@ int
 	return 1;
 }
 
-unsigned char* convert_image_to_DXT1(
-		const unsigned char *const uncompressed,
-		int width, int height, int channels,
-		int *out_size )
+/*	what a job compressing a band of block rows needs to know	*/
+typedef struct
 {
+	const unsigned char *uncompressed;
 	unsigned char *compressed;
+	int width, height, channels;
+	int chan_step, has_alpha;
+} DXT_job;
+
+/*	compresses the 4 pixel high block rows [start,end) to DXT1	*/
+static void DXT1_block_rows( void *data, int start, int end )
+{
+	const DXT_job *job = (const DXT_job*)data;
+	const unsigned char *const uncompressed = job->uncompressed;
+	int width = job->width, height = job->height;
+	int channels = job->channels, chan_step = job->chan_step;
 	int i, j, x, y;
 	unsigned char ublock[16*3];
 	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || (channels > 4) )
-	{
-		return NULL;
-	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
+	/*	each block row is ((width+3)/4) blocks of 8 bytes	*/
+	int index = start * ((width+3) >> 2) * 8;
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	for( j = start*4; j < end*4; j += 4 )
 	{
 		for( i = 0; i < width; i += 4 )
 		{
@@ -167,50 +164,31 @@ unsigned char* convert_image_to_DXT1(
 				}
 			}
 			/*	compress the block	*/
-			++block_count;
 			compress_DDS_color_block( 3, ublock, cblock );
 			/*	copy the data from the block into the main block	*/
 			for( x = 0; x < 8; ++x )
 			{
-				compressed[index++] = cblock[x];
+				job->compressed[index++] = cblock[x];
 			}
 		}
 	}
-	return compressed;
 }
 
-unsigned char* convert_image_to_DXT5(
-		const unsigned char *const uncompressed,
-		int width, int height, int channels,
-		int *out_size )
+/*	compresses the 4 pixel high block rows [start,end) to DXT5	*/
+static void DXT5_block_rows( void *data, int start, int end )
 {
-	unsigned char *compressed;
+	const DXT_job *job = (const DXT_job*)data;
+	const unsigned char *const uncompressed = job->uncompressed;
+	int width = job->width, height = job->height;
+	int channels = job->channels, chan_step = job->chan_step;
+	int has_alpha = job->has_alpha;
 	int i, j, x, y;
 	unsigned char ublock[16*4];
 	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || ( channels > 4) )
-	{
-		return NULL;
-	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
+	/*	each block row is ((width+3)/4) blocks of 16 bytes	*/
+	int index = start * ((width+3) >> 2) * 16;
 	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	for( j = start*4; j < end*4; j += 4 )
 	{
 		for( i = 0; i < width; i += 4 )
 		{
@@ -259,19 +237,88 @@ unsigned char* convert_image_to_DXT5(
 			/*	copy the data from the compressed alpha block into the main buffer	*/
 			for( x = 0; x < 8; ++x )
 			{
-				compressed[index++] = cblock[x];
+				job->compressed[index++] = cblock[x];
 			}
 			/*	then compress the color block	*/
-			++block_count;
 			compress_DDS_color_block( 4, ublock, cblock );
 			/*	copy the data from the compressed color block into the main buffer	*/
 			for( x = 0; x < 8; ++x )
 			{
-				compressed[index++] = cblock[x];
+				job->compressed[index++] = cblock[x];
 			}
 		}
 	}
-	return compressed;
+}
+
+unsigned char* convert_image_to_DXT1(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	DXT_job job;
+	/*	error check	*/
+	*out_size = 0;
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) ||
+		(channels < 1) || (channels > 4) )
+	{
+		return NULL;
+	}
+	job.uncompressed = uncompressed;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
+	job.chan_step = (channels < 3) ? 0 : 1;
+	job.has_alpha = 0;
+	/*	get the RAM for the compressed image
+		(8 bytes per 4x4 pixel block)	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
+	job.compressed = (unsigned char*)malloc( *out_size );
+	if( NULL == job.compressed )
+	{
+		*out_size = 0;
+		return NULL;
+	}
+	/*	block rows are independent, so spread them over the job threads	*/
+	jobs_parallel_for( DXT1_block_rows, &job, (height+3) >> 2, DXT_ROWS_PER_JOB );
+	return job.compressed;
+}
+
+unsigned char* convert_image_to_DXT5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	DXT_job job;
+	/*	error check	*/
+	*out_size = 0;
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) ||
+		(channels < 1) || ( channels > 4) )
+	{
+		return NULL;
+	}
+	job.uncompressed = uncompressed;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
+	job.chan_step = (channels < 3) ? 0 : 1;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	job.has_alpha = 1 - (channels & 1);
+	/*	get the RAM for the compressed image
+		(16 bytes per 4x4 pixel block)	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
+	job.compressed = (unsigned char*)malloc( *out_size );
+	if( NULL == job.compressed )
+	{
+		*out_size = 0;
+		return NULL;
+	}
+	/*	block rows are independent, so spread them over the job threads	*/
+	jobs_parallel_for( DXT5_block_rows, &job, (height+3) >> 2, DXT_ROWS_PER_JOB );
+	return job.compressed;
 }
 
 /********* Helper Functions *********/
@@ -7,38 +7,41 @@
 */
 
 #include "image_helper.h"
+#include "../jobs.h"
 #include <stdlib.h>
 #include <math.h>
 
-/*	Upscaling the image uses simple bilinear interpolation	*/
-int
-	up_scale_image
-	(
-		const unsigned char* const orig,
-		int width, int height, int channels,
-		unsigned char* resampled,
-		int resampled_width, int resampled_height
-	)
+/*	output rows each job resamples at least	*/
+#define RESAMPLE_ROWS_PER_JOB	32
+
+/*	what a job resampling a band of output rows needs to know	*/
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int resampled_width, resampled_height;
+	int block_size_x, block_size_y;
+} resample_job;
+
+/*	bilinearly samples the output rows [start,end)	*/
+static void up_scale_rows( void *data, int start, int end )
 {
+	const resample_job *job = (const resample_job*)data;
+	const unsigned char* const orig = job->orig;
+	int width = job->width, height = job->height, channels = job->channels;
+	unsigned char* resampled = job->resampled;
+	int resampled_width = job->resampled_width;
 	float dx, dy;
 	int x, y, c;
 
-    /* error(s) check	*/
-    if ( 	(width < 1) || (height < 1) ||
-            (resampled_width < 2) || (resampled_height < 2) ||
-            (channels < 1) ||
-            (NULL == orig) || (NULL == resampled) )
-    {
-        /*	signify badness	*/
-        return 0;
-    }
     /*
 		for each given pixel in the new map, find the exact location
 		from the original map which would contribute to this guy
 	*/
     dx = (width - 1.0f) / (resampled_width - 1.0f);
-    dy = (height - 1.0f) / (resampled_height - 1.0f);
-    for ( y = 0; y < resampled_height; ++y )
+    dy = (height - 1.0f) / (job->resampled_height - 1.0f);
+    for ( y = start; y < end; ++y )
     {
     	/* find the base y index and fractional offset from that	*/
     	float sampley = y * dy;
@@ -77,42 +80,55 @@ int
             }
         }
     }
-    /*	done	*/
-    return 1;
 }
 
+/*	Upscaling the image uses simple bilinear interpolation	*/
 int
-	mipmap_image
+	up_scale_image
 	(
 		const unsigned char* const orig,
 		int width, int height, int channels,
 		unsigned char* resampled,
-		int block_size_x, int block_size_y
+		int resampled_width, int resampled_height
 	)
 {
-	int mip_width, mip_height;
+	resample_job job;
+
+    /* error(s) check	*/
+    if ( 	(width < 1) || (height < 1) ||
+            (resampled_width < 2) || (resampled_height < 2) ||
+            (channels < 1) ||
+            (NULL == orig) || (NULL == resampled) )
+    {
+        /*	signify badness	*/
+        return 0;
+    }
+    /*	rows are independent, so spread them over the job threads	*/
+    job.orig = orig;
+    job.width = width;
+    job.height = height;
+    job.channels = channels;
+    job.resampled = resampled;
+    job.resampled_width = resampled_width;
+    job.resampled_height = resampled_height;
+    jobs_parallel_for( up_scale_rows, &job, resampled_height,
+                       RESAMPLE_ROWS_PER_JOB );
+    /*	done	*/
+    return 1;
+}
+
+/*	averages the blocks making up the output rows [start,end)	*/
+static void mipmap_rows( void *data, int start, int end )
+{
+	const resample_job *job = (const resample_job*)data;
+	const unsigned char* const orig = job->orig;
+	int width = job->width, height = job->height, channels = job->channels;
+	unsigned char* resampled = job->resampled;
+	int mip_width = job->resampled_width;
+	int block_size_x = job->block_size_x, block_size_y = job->block_size_y;
 	int i, j, c;
 
-	/*	error check	*/
-	if( (width < 1) || (height < 1) ||
-		(channels < 1) || (orig == NULL) ||
-		(resampled == NULL) ||
-		(block_size_x < 1) || (block_size_y < 1) )
-	{
-		/*	nothing to do	*/
-		return 0;
-	}
-	mip_width = width / block_size_x;
-	mip_height = height / block_size_y;
-	if( mip_width < 1 )
-	{
-		mip_width = 1;
-	}
-	if( mip_height < 1 )
-	{
-		mip_height = 1;
-	}
-	for( j = 0; j < mip_height; ++j )
+	for( j = start; j < end; ++j )
 	{
 		for( i = 0; i < mip_width; ++i )
 		{
@@ -148,6 +164,50 @@ int
 			}
 		}
 	}
+}
+
+int
+	mipmap_image
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y
+	)
+{
+	resample_job job;
+	int mip_width, mip_height;
+
+	/*	error check	*/
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (orig == NULL) ||
+		(resampled == NULL) ||
+		(block_size_x < 1) || (block_size_y < 1) )
+	{
+		/*	nothing to do	*/
+		return 0;
+	}
+	mip_width = width / block_size_x;
+	mip_height = height / block_size_y;
+	if( mip_width < 1 )
+	{
+		mip_width = 1;
+	}
+	if( mip_height < 1 )
+	{
+		mip_height = 1;
+	}
+	/*	rows are independent, so spread them over the job threads	*/
+	job.orig = orig;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.resampled = resampled;
+	job.resampled_width = mip_width;
+	job.resampled_height = mip_height;
+	job.block_size_x = block_size_x;
+	job.block_size_y = block_size_y;
+	jobs_parallel_for( mipmap_rows, &job, mip_height, RESAMPLE_ROWS_PER_JOB );
 	return 1;
 }
 
@@ -114,8 +114,9 @@ typedef unsigned char validate_uint32[sizeof(uint32)==4];
 // Generic API that works on all image types
 //
 
-// this is not threadsafe
-static char *failure_reason;
+// one per thread, so images decoding on worker threads don't overwrite
+// each other's reason before it is read
+static __thread char *failure_reason;
 
 char *stbi_failure_reason(void)
 {
@@ -320,12 +321,33 @@ extern int      stbi_is_hdr_from_file(FILE *f)
 
 #endif
 
-// @TODO: get image dimensions & components without fully decoding
+// get image dimensions & components without fully decoding
+// only JPEG and PNG headers are read so far; other formats fail
 #ifndef STBI_NO_STDIO
-extern int      stbi_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_info(char const *filename, int *x, int *y, int *comp)
+{
+   FILE *f = fopen(filename, "rb");
+   int r;
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_info_from_file(f, x,y,comp);
+   fclose(f);
+   return r;
+}
+
+int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   if (stbi_jpeg_info_from_file(f,x,y,comp)) return 1;
+   if (stbi_png_info_from_file(f,x,y,comp)) return 1;
+   return e("unknown image type", "Image not of any known type, or corrupt");
+}
 #endif
-extern int      stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   if (stbi_jpeg_info_from_memory(buffer,len,x,y,comp)) return 1;
+   if (stbi_png_info_from_memory(buffer,len,x,y,comp)) return 1;
+   return e("unknown image type", "Image not of any known type, or corrupt");
+}
 
 #ifndef STBI_NO_HDR
 static float h2l_gamma_i=1.0f/2.2f, h2l_scale_i=1.0f;
@@ -1589,12 +1611,44 @@ int stbi_jpeg_test_memory(stbi_uc const *buffer, int len)
    return decode_jpeg_header(&j, SCAN_type);
 }
 
-// @TODO:
+static int jpeg_info(jpeg *j, int *x, int *y, int *comp)
+{
+   if (!decode_jpeg_header(j, SCAN_header)) return 0;
+   if (x) *x = j->s.img_x;
+   if (y) *y = j->s.img_y;
+   if (comp) *comp = j->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_jpeg_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_jpeg_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_jpeg_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   int n,r;
+   jpeg j;
+   n = ftell(f);
+   start_file(&j.s, f);
+   r = jpeg_info(&j, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+
+int stbi_jpeg_info(char const *filename, int *x, int *y, int *comp)
+{
+   FILE *f = fopen(filename, "rb");
+   int r;
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_jpeg_info_from_file(f, x,y,comp);
+   fclose(f);
+   return r;
+}
 #endif
-extern int      stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   jpeg j;
+   start_mem(&j.s, buffer,len);
+   return jpeg_info(&j, x,y,comp);
+}
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
 //    simple implementation
@@ -2427,12 +2481,44 @@ int stbi_png_test_memory(stbi_uc const *buffer, int len)
    return parse_png_file(&p, SCAN_type,STBI_default);
 }
 
-// TODO: load header from png
+static int png_info(png *p, int *x, int *y, int *comp)
+{
+   if (!parse_png_file(p, SCAN_header, 0)) return 0;
+   if (x) *x = p->s.img_x;
+   if (y) *y = p->s.img_y;
+   if (comp) *comp = p->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_png_info             (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_png_info_from_file   (FILE *f,                  int *x, int *y, int *comp);
+int stbi_png_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   png p;
+   int n,r;
+   n = ftell(f);
+   start_file(&p.s, f);
+   r = png_info(&p, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+
+int stbi_png_info(char const *filename, int *x, int *y, int *comp)
+{
+   FILE *f = fopen(filename, "rb");
+   int r;
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_png_info_from_file(f, x,y,comp);
+   fclose(f);
+   return r;
+}
 #endif
-extern int      stbi_png_info_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_png_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   png p;
+   start_mem(&p.s, buffer, len);
+   return png_info(&p, x,y,comp);
+}
 
 // Microsoft/Windows BMP image
 
@@ -0,0 +1,491 @@
+/**
+   @file loadgen.c
+
+   Drives the game server with many concurrent sessions and reports
+   throughput and request latency.
+
+   Each connection plays one session at a time: it starts a game, fetches
+   the board, then makes random legal moves, keeping one request in flight.
+   Clients mirror the board locally to pick legal moves and check every
+   reply against it.  When a session has made its moves the connection is
+   closed and a new one opened, until the requested number of sessions have
+   been played.  Connections are split over threads, each running its own
+   epoll loop.
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../board.h"
+#include "../util.h"
+#include "protocol.h"
+
+/** Latencies are counted per microsecond up to this, then lumped. */
+#define LATENCY_BUCKETS 100000
+
+#define MAX_EVENTS 256
+
+typedef struct client {
+  int      fd;
+
+  /** Board as the server should have it after the request in flight. */
+  board_t  board;
+  board_t  expected;
+
+  uint8_t  op;
+  int      moves_left;
+  double   sent_time;
+
+  uint8_t  reply[PROTOCOL_BOARD_REPLY_SIZE];
+  int      reply_used;
+} client_t;
+
+typedef struct load_thread {
+  pthread_t thread;
+  int       epoll_fd;
+
+  client_t* clients;
+  int       client_count;
+  uint32_t  random;
+
+  /** Counts of request latencies in microseconds; the last is overflow. */
+  uint32_t* latencies;
+  uint64_t  moves;
+  uint64_t  sessions;
+  uint64_t  errors;
+} load_thread_t;
+
+static int         port = PROTOCOL_DEFAULT_PORT;
+static const char* unix_path = NULL;
+static int         board_size = 4;
+static int         moves_per_session = 100;
+
+/** Sessions not yet started, shared by every thread. */
+static long        sessions_left = 10000;
+
+static double
+now(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static uint32_t
+next_random(uint32_t* state) {
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  return x;
+}
+
+static int
+connect_to_server(void) {
+  int fd;
+  int result;
+
+  if(unix_path != NULL) {
+    struct sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, unix_path, sizeof(address.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    result = connect(fd, (struct sockaddr*)&address, sizeof(address));
+  } else {
+    struct sockaddr_in address;
+    int                no_delay = 1;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    result = connect(fd, (struct sockaddr*)&address, sizeof(address));
+  }
+
+  if(fd < 0 || result != 0) {
+    perror("Unable to connect");
+    exit(1);
+  }
+
+  return fd;
+}
+
+static void
+send_request(client_t* client, uint8_t op, uint8_t argument) {
+  uint8_t request[PROTOCOL_REQUEST_SIZE] = { op, argument };
+
+  client->op = op;
+  client->reply_used = 0;
+  client->sent_time = now();
+
+  // The socket buffer is empty with only one request in flight.
+  if(write(client->fd, request, sizeof(request)) != sizeof(request)) {
+    perror("Unable to send a request");
+    exit(1);
+  }
+}
+
+/**
+   Opens a connection for the next session, if any are left.
+
+   @return
+     False once every session has been started.
+*/
+static bool
+start_session(load_thread_t* thread, client_t* client) {
+  struct epoll_event event;
+
+  if(__atomic_sub_fetch(&sessions_left, 1, __ATOMIC_RELAXED) < 0) {
+    client->fd = -1;
+    return false;
+  }
+
+  client->fd = connect_to_server();
+  client->moves_left = moves_per_session;
+
+  event.events = EPOLLIN;
+  event.data.ptr = client;
+  epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, client->fd, &event);
+
+  send_request(client, PROTOCOL_NEW, board_size);
+  return true;
+}
+
+static void
+send_move(load_thread_t* thread, client_t* client) {
+  direction_t direction;
+
+  do {
+    client->expected = client->board;
+    direction = next_random(&thread->random) & 3;
+  } while(!board_move(&client->expected, direction));
+
+  send_request(client, PROTOCOL_MOVE, direction);
+}
+
+/**
+   Checks a complete reply and sends the next request.
+
+   @return
+     False when the session is over.
+*/
+static bool
+handle_reply(load_thread_t* thread, client_t* client) {
+  uint8_t* reply = client->reply;
+  double   latency = now() - client->sent_time;
+  int      bucket = min(latency * 1e6, LATENCY_BUCKETS);
+
+  thread->latencies[bucket]++;
+
+  if(client->op == PROTOCOL_NEW) {
+    if(reply[1] != PROTOCOL_OK) {
+      thread->errors++;
+      return false;
+    }
+
+    send_request(client, PROTOCOL_GET, 0);
+  } else if(client->op == PROTOCOL_GET) {
+    client->board.size = reply[3];
+    client->board.blank = reply[2];
+
+    for(int i = 0; i < BOARD_WORDS; i++) {
+      const uint8_t* word = reply + PROTOCOL_REPLY_SIZE + i * 8;
+
+      client->board.words[i] = protocol_get_u32(word) |
+        (uint64_t)protocol_get_u32(word + 4) << 32;
+    }
+
+    if(reply[1] != PROTOCOL_OK || client->board.size != board_size) {
+      thread->errors++;
+      return false;
+    }
+
+    send_move(thread, client);
+  } else {
+    bool solved = board_is_solved(&client->expected);
+
+    thread->moves++;
+
+    if(reply[1] != (solved ? PROTOCOL_SOLVED : PROTOCOL_OK) ||
+       reply[2] != client->expected.blank)
+    {
+      thread->errors++;
+      return false;
+    }
+
+    client->board = client->expected;
+    client->moves_left--;
+
+    if(client->moves_left == 0) {
+      thread->sessions++;
+      return false;
+    }
+
+    send_move(thread, client);
+  }
+
+  return true;
+}
+
+/**
+   Reads what's arrived of the reply in flight.
+
+   @return
+     False when the session is over.
+*/
+static bool
+read_reply(load_thread_t* thread, client_t* client) {
+  int     size = client->op == PROTOCOL_GET ? PROTOCOL_BOARD_REPLY_SIZE :
+    PROTOCOL_REPLY_SIZE;
+  ssize_t count = read(client->fd, client->reply + client->reply_used,
+                       size - client->reply_used);
+
+  if(count <= 0) {
+    if(count < 0 && errno == EINTR) {
+      return true;
+    }
+
+    thread->errors++;
+    return false;
+  }
+
+  client->reply_used += count;
+
+  return client->reply_used < size || handle_reply(thread, client);
+}
+
+static void*
+run_thread(void* data) {
+  load_thread_t*     thread = data;
+  struct epoll_event events[MAX_EVENTS];
+  int                open = 0;
+
+  for(int i = 0; i < thread->client_count; i++) {
+    open += start_session(thread, thread->clients + i);
+  }
+
+  while(open > 0) {
+    int count = epoll_wait(thread->epoll_fd, events, MAX_EVENTS, -1);
+
+    for(int i = 0; i < count; i++) {
+      client_t* client = events[i].data.ptr;
+
+      if(!read_reply(thread, client)) {
+        close(client->fd);
+        open -= !start_session(thread, client);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/**
+   Gets the latency below which the given fraction of requests fell.
+*/
+static double
+latency_percentile(const uint32_t* latencies, uint64_t total,
+                   double fraction)
+{
+  uint64_t target = total * fraction;
+  uint64_t seen = 0;
+
+  for(int i = 0; i <= LATENCY_BUCKETS; i++) {
+    seen += latencies[i];
+    if(seen > target) {
+      return i;
+    }
+  }
+
+  return LATENCY_BUCKETS;
+}
+
+static void
+raise_fd_limit(void) {
+  struct rlimit limit;
+
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static void
+print_usage(void) {
+  printf("Load generator for the game server.\n"
+         "loadgen [options]\n"
+         "\n"
+         "Options:\n"
+         "\t--(p)ort [port]           Server port on 127.0.0.1.  Defaults to "
+         "%d.\n"
+         "\t--(u)nix [path]           Connects to a Unix socket instead.\n"
+         "\t--(c)onnections [count]   Concurrent sessions.  Defaults to "
+         "1000.\n"
+         "\t--(s)essions [count]      Sessions to play in total.  Defaults to "
+         "10000.\n"
+         "\t--(m)oves [count]         Moves per session.  Defaults to 100.\n"
+         "\t--si(z)e [tiles]          Board size.  Defaults to 4.\n"
+         "\t--(t)hreads [count]       Client threads.  Defaults to the number "
+         "of cores.\n", PROTOCOL_DEFAULT_PORT);
+}
+
+int main(int argc, char** argv) {
+  int            connection_count = 1000;
+  long           thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  load_thread_t* threads;
+  client_t*      clients;
+  uint32_t*      latencies;
+  uint64_t       requests = 0;
+  uint64_t       moves = 0;
+  uint64_t       sessions = 0;
+  uint64_t       errors = 0;
+  double         start;
+  double         elapsed;
+
+  for(int i = 1; i < argc; i++) {
+    const char* option = argv[i];
+    bool        has_value = i + 1 < argc;
+
+    if((strcmp(option, "-p") == 0 || strcmp(option, "--port") == 0)
+       && has_value)
+    {
+      port = atoi(argv[++i]);
+    }
+
+    else if((strcmp(option, "-u") == 0 || strcmp(option, "--unix") == 0)
+            && has_value)
+    {
+      unix_path = argv[++i];
+    }
+
+    else if((strcmp(option, "-c") == 0 ||
+             strcmp(option, "--connections") == 0) && has_value)
+    {
+      connection_count = atoi(argv[++i]);
+    }
+
+    else if((strcmp(option, "-s") == 0 ||
+             strcmp(option, "--sessions") == 0) && has_value)
+    {
+      sessions_left = atol(argv[++i]);
+    }
+
+    else if((strcmp(option, "-m") == 0 || strcmp(option, "--moves") == 0)
+            && has_value)
+    {
+      moves_per_session = atoi(argv[++i]);
+    }
+
+    else if((strcmp(option, "-z") == 0 || strcmp(option, "--size") == 0)
+            && has_value)
+    {
+      board_size = atoi(argv[++i]);
+    }
+
+    else if((strcmp(option, "-t") == 0 || strcmp(option, "--threads") == 0)
+            && has_value)
+    {
+      thread_count = atol(argv[++i]);
+    }
+
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if(board_size < 2 || board_size > BOARD_MAX_SIZE ||
+     connection_count < 1 || moves_per_session < 1)
+  {
+    print_usage();
+    return 1;
+  }
+
+  thread_count = max(min(thread_count, connection_count), 1);
+
+  raise_fd_limit();
+
+  threads = new_array(load_thread_t, thread_count);
+  clients = new_array(client_t, connection_count);
+
+  start = now();
+
+  for(long i = 0; i < thread_count; i++) {
+    load_thread_t* thread = threads + i;
+    int            first = connection_count * i / thread_count;
+    int            end = connection_count * (i + 1) / thread_count;
+
+    thread->epoll_fd = epoll_create1(0);
+    thread->clients = clients + first;
+    thread->client_count = end - first;
+    thread->random = 2654435761u * (i + 1);
+    thread->latencies = new_array(uint32_t, LATENCY_BUCKETS + 1);
+
+    pthread_create(&thread->thread, NULL, run_thread, thread);
+  }
+
+  latencies = new_array(uint32_t, LATENCY_BUCKETS + 1);
+
+  for(long i = 0; i < thread_count; i++) {
+    load_thread_t* thread = threads + i;
+
+    pthread_join(thread->thread, NULL);
+
+    for(int j = 0; j <= LATENCY_BUCKETS; j++) {
+      latencies[j] += thread->latencies[j];
+      requests += thread->latencies[j];
+    }
+
+    moves += thread->moves;
+    sessions += thread->sessions;
+    errors += thread->errors;
+
+    close(thread->epoll_fd);
+    delete(thread->latencies);
+  }
+
+  elapsed = now() - start;
+
+  printf("%llu sessions, %llu moves in %.2f s with %d connections on %ld "
+         "threads\n", (unsigned long long)sessions,
+         (unsigned long long)moves, elapsed, connection_count, thread_count);
+  printf("%.0f sessions/s, %.0f moves/s, %llu errors\n",
+         sessions / elapsed, moves / elapsed, (unsigned long long)errors);
+  printf("latency us: p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f%s\n",
+         latency_percentile(latencies, requests, 0.5),
+         latency_percentile(latencies, requests, 0.9),
+         latency_percentile(latencies, requests, 0.99),
+         latency_percentile(latencies, requests, 0.999),
+         latencies[LATENCY_BUCKETS] > 0 ? " (some over 100 ms)" : "");
+
+  delete(latencies);
+  delete(clients);
+  delete(threads);
+
+  return errors > 0;
+}
@@ -0,0 +1,69 @@
+/**
+   @file protocol.h
+
+   Binary protocol spoken between the game server and its clients.  Every
+   request is two bytes, an opcode and an argument.  Every reply starts with
+   the same eight byte header:
+
+     byte 0     opcode of the request | PROTOCOL_REPLY
+     byte 1     status, one of protocol_status_t
+     byte 2     cell index of the empty slot
+     byte 3     board size
+     bytes 4-7  move count, little-endian
+
+   PROTOCOL_GET replies are followed by the packed board words, eight bytes
+   each, little-endian.  Requests are answered in order, so clients may
+   pipeline them.
+*/
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+#include "../board.h"
+
+#define PROTOCOL_DEFAULT_PORT 7878
+
+#define PROTOCOL_REQUEST_SIZE 2
+#define PROTOCOL_REPLY_SIZE 8
+#define PROTOCOL_BOARD_REPLY_SIZE (PROTOCOL_REPLY_SIZE + BOARD_WORDS * 8)
+
+/** Set in the opcode byte of replies. */
+#define PROTOCOL_REPLY 0x80
+
+typedef enum protocol_op {
+  /** Starts a new shuffled game on the connection.  Argument: board size. */
+  PROTOCOL_NEW  = 1,
+  /** Slides a tile.  Argument: a direction_t. */
+  PROTOCOL_MOVE = 2,
+  /** Gets the whole board.  Argument unused. */
+  PROTOCOL_GET  = 3
+} protocol_op_t;
+
+typedef enum protocol_status {
+  PROTOCOL_OK,
+  /** No tile can slide that way.  Nothing changed. */
+  PROTOCOL_ILLEGAL,
+  /** The move finished the game. */
+  PROTOCOL_SOLVED,
+  /** Unknown opcode or bad argument. */
+  PROTOCOL_BAD_REQUEST,
+  /** A move came before any PROTOCOL_NEW. */
+  PROTOCOL_NO_GAME
+} protocol_status_t;
+
+static inline void
+protocol_put_u32(uint8_t* bytes, uint32_t value) {
+  bytes[0] = value;
+  bytes[1] = value >> 8;
+  bytes[2] = value >> 16;
+  bytes[3] = value >> 24;
+}
+
+static inline uint32_t
+protocol_get_u32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+    ((uint32_t)bytes[3] << 24);
+}
+
+#endif
@@ -0,0 +1,906 @@
+/**
+   @file server.c
+
+   Hosts sliding tile games for clients on the local machine.  Each
+   connection is one session with its own board, driven by the two byte
+   requests described in protocol.h.
+
+   The main thread accepts connections and hands them round robin to worker
+   threads.  Every worker runs its own epoll loop over the sessions it was
+   given and applies their moves itself, so sessions are never shared
+   between threads and need no locks.  Session state lives in a per-worker
+   slab of fixed size records, so starting and ending sessions doesn't go
+   through malloc.
+
+   The game's graphics state (sprites, textures) can't exist without a
+   window, so sessions hold the logical board from board.h, the same model
+   the verify tool replays solutions on.
+
+   With --spectate, every game's moves are also published to a stream ring
+   (stream.h) for spectators.  Moves are batched per game and published
+   every SPECTATE_FLUSH_INTERVAL seconds, with a keyframe when a game starts
+   and then every SPECTATE_KEYFRAME_INTERVAL seconds while it's being
+   played.
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../board.h"
+#include "../util.h"
+#include "protocol.h"
+#include "stream.h"
+
+/** Records carved out of each slab chunk. */
+#define SLAB_CHUNK_OBJECTS 256
+
+/** Replies a session can have waiting to be written. */
+#define SESSION_OUTPUT_SIZE 1024
+
+#define READ_BUFFER_SIZE 65536
+#define MAX_EVENTS 256
+
+/** Random moves made from the solved board to start a game. */
+#define SHUFFLE_MOVES 400
+
+/** Longest a move waits before it's published to spectators. */
+#define SPECTATE_FLUSH_INTERVAL 0.05
+
+/** Least time between keyframes of a game being played. */
+#define SPECTATE_KEYFRAME_INTERVAL 2.0
+
+#define SPECTATE_RING_SIZE (4 << 20)
+
+//==============================================================================
+// Slab allocator
+//==============================================================================
+
+typedef struct slab_free {
+  struct slab_free* next;
+} slab_free_t;
+
+/**
+   Hands out fixed size records from large chunks.  Freed records go on a
+   free list and are reused first; chunks are only returned on destroy.
+   Not thread safe, so each worker has its own.
+*/
+typedef struct slab {
+  size_t       object_size;
+  slab_free_t* free_list;
+
+  void**       chunks;
+  int          chunk_count;
+
+  /** Records currently handed out. */
+  int          in_use;
+} slab_t;
+
+static void
+slab_init(slab_t* slab, size_t object_size) {
+  memset(slab, 0, sizeof(slab_t));
+
+  // Keep every record aligned for any member type.
+  slab->object_size = (max(object_size, sizeof(slab_free_t)) + 15) & ~15;
+}
+
+static void*
+slab_alloc(slab_t* slab) {
+  slab_free_t* object;
+
+  if(slab->free_list == NULL) {
+    char* chunk = malloc(slab->object_size * SLAB_CHUNK_OBJECTS);
+
+    slab->chunks = realloc(slab->chunks,
+                           (slab->chunk_count + 1) * sizeof(void*));
+    if(chunk == NULL || slab->chunks == NULL) {
+      logmsg("Unable to grow a slab to %d chunks.", slab->chunk_count + 1);
+      exit(1);
+    }
+
+    slab->chunks[slab->chunk_count++] = chunk;
+
+    for(int i = SLAB_CHUNK_OBJECTS - 1; i >= 0; i--) {
+      slab_free_t* free_object =
+        (slab_free_t*)(chunk + i * slab->object_size);
+
+      free_object->next = slab->free_list;
+      slab->free_list = free_object;
+    }
+  }
+
+  object = slab->free_list;
+  slab->free_list = object->next;
+  slab->in_use++;
+
+  return object;
+}
+
+static void
+slab_free(slab_t* slab, void* object) {
+  slab_free_t* free_object = object;
+
+  free_object->next = slab->free_list;
+  slab->free_list = free_object;
+  slab->in_use--;
+}
+
+static void
+slab_destroy(slab_t* slab) {
+  for(int i = 0; i < slab->chunk_count; i++) {
+    free(slab->chunks[i]);
+  }
+
+  free(slab->chunks);
+  memset(slab, 0, sizeof(slab_t));
+}
+
+//==============================================================================
+// Sessions
+//==============================================================================
+
+typedef struct session {
+  int      fd;
+
+  board_t  board;
+  uint32_t move_count;
+  bool     playing;
+  uint32_t random;
+
+  /** First byte of a request that was split across reads. */
+  uint8_t  partial;
+  bool     has_partial;
+
+  /** Replies not yet written, from output_start up to output_end. */
+  uint8_t  output[SESSION_OUTPUT_SIZE];
+  int      output_start;
+  int      output_end;
+
+  /** Events the session is registered for in its worker's epoll set. */
+  uint32_t events;
+
+  /** Id the game is published under when spectating. */
+  uint64_t game_id;
+  /** Moves not yet published, with the milliseconds before each. */
+  uint8_t  spectate_moves[STREAM_MAX_MOVES];
+  uint32_t spectate_delays[STREAM_MAX_MOVES];
+  int      spectate_count;
+  /** Times of the game's latest published move or keyframe. */
+  double   spectate_time;
+  double   keyframe_time;
+
+  /** Links sessions with unpublished moves, while spectate_count > 0. */
+  struct session* dirty_next;
+  struct session* dirty_prev;
+} session_t;
+
+typedef struct worker {
+  pthread_t  thread;
+  int        index;
+  int        epoll_fd;
+
+  /** New connections arrive from the acceptor as fds on this pipe. */
+  int        handoff[2];
+
+  slab_t     sessions;
+  uint8_t    buffer[READ_BUFFER_SIZE];
+
+  /** Totals, read by the main thread while the worker runs. */
+  uint64_t   moves;
+  uint64_t   games;
+  /** Connections taken in, so every session gets its own seed. */
+  uint32_t   connections;
+
+  /** Clock reading taken after each wait for events. */
+  double     time;
+  double     last_flush;
+  /** Sessions with moves to publish. */
+  session_t* dirty;
+} worker_t;
+
+static volatile sig_atomic_t stopping = 0;
+
+static long worker_count;
+
+/** Set when publishing to spectators.  Workers take turns writing. */
+static stream_writer_t* spectate = NULL;
+static pthread_mutex_t  spectate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double
+now(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static uint32_t
+next_random(uint32_t* state) {
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  return x;
+}
+
+/**
+   Seeds a new session's shuffles.  Fds are reused as soon as they close, so
+   they would give reconnecting clients the same boards again.  The worker,
+   its connection count and the clock are mixed instead.
+*/
+static uint32_t
+session_seed(worker_t* worker) {
+  uint32_t seed = (uint32_t)(now() * 1e9);
+
+  worker->connections++;
+  seed ^= worker->connections * 2654435761u;
+  seed ^= (uint32_t)worker->index * 0x85ebca6bu;
+
+  // Murmur3's finalizer, so nearby seeds shuffle nothing alike.
+  seed ^= seed >> 16;
+  seed *= 0x85ebca6bu;
+  seed ^= seed >> 13;
+  seed *= 0xc2b2ae35u;
+  seed ^= seed >> 16;
+
+  return seed | 1;
+}
+
+static void
+start_game(session_t* session, int size) {
+  board_init(&session->board, size);
+
+  for(int i = 0; i < SHUFFLE_MOVES; i++) {
+    board_move(&session->board, next_random(&session->random) & 3);
+  }
+
+  session->move_count = 0;
+  session->playing = true;
+}
+
+//==============================================================================
+// Spectating
+//==============================================================================
+
+static void
+publish(const stream_record_t* record) {
+  uint8_t buffer[STREAM_MAX_RECORD];
+  size_t  size = stream_encode(record, buffer);
+
+  pthread_mutex_lock(&spectate_lock);
+  stream_write(spectate, buffer, size);
+  pthread_mutex_unlock(&spectate_lock);
+}
+
+static void
+publish_keyframe(worker_t* worker, session_t* session) {
+  stream_record_t record;
+
+  record.kind = STREAM_KEYFRAME;
+  record.game = session->game_id;
+  record.time = stream_time(spectate->ring);
+  record.move_count = session->move_count;
+  record.board = session->board;
+  publish(&record);
+
+  session->spectate_time = worker->time;
+  session->keyframe_time = worker->time;
+}
+
+/**
+   Publishes a session's waiting moves, then a keyframe if one is due.
+*/
+static void
+publish_moves(worker_t* worker, session_t* session) {
+  if(session->spectate_count > 0) {
+    stream_record_t record;
+
+    record.kind = STREAM_MOVES;
+    record.game = session->game_id;
+    record.count = session->spectate_count;
+    memcpy(record.directions, session->spectate_moves, record.count);
+    memcpy(record.delays, session->spectate_delays,
+           record.count * sizeof(uint32_t));
+    publish(&record);
+
+    session->spectate_count = 0;
+
+    if(session->dirty_prev != NULL) {
+      session->dirty_prev->dirty_next = session->dirty_next;
+    } else {
+      worker->dirty = session->dirty_next;
+    }
+
+    if(session->dirty_next != NULL) {
+      session->dirty_next->dirty_prev = session->dirty_prev;
+    }
+  }
+
+  if(worker->time - session->keyframe_time >= SPECTATE_KEYFRAME_INTERVAL) {
+    publish_keyframe(worker, session);
+  }
+}
+
+static void
+publish_end(worker_t* worker, session_t* session) {
+  stream_record_t record;
+
+  publish_moves(worker, session);
+
+  record.kind = STREAM_END;
+  record.game = session->game_id;
+  publish(&record);
+}
+
+/**
+   Holds a move to be published with the game's next batch.
+*/
+static void
+spectate_move(worker_t* worker, session_t* session, direction_t direction) {
+  int count = session->spectate_count;
+
+  session->spectate_moves[count] = direction;
+  session->spectate_delays[count] =
+    (worker->time - session->spectate_time) * 1000 + 0.5;
+  session->spectate_time = worker->time;
+
+  if(count == 0) {
+    session->dirty_prev = NULL;
+    session->dirty_next = worker->dirty;
+    if(worker->dirty != NULL) {
+      worker->dirty->dirty_prev = session;
+    }
+    worker->dirty = session;
+  }
+
+  session->spectate_count++;
+  if(session->spectate_count == STREAM_MAX_MOVES) {
+    publish_moves(worker, session);
+  }
+}
+
+//==============================================================================
+// Requests
+//==============================================================================
+
+/**
+   Answers one request, adding the reply to the session's output.
+*/
+static void
+handle_request(worker_t* worker, session_t* session, uint8_t op,
+               uint8_t argument)
+{
+  uint8_t* reply = session->output + session->output_end;
+  int      size = PROTOCOL_REPLY_SIZE;
+  int      status = PROTOCOL_OK;
+
+  if(op == PROTOCOL_NEW) {
+    if(argument >= 2 && argument <= BOARD_MAX_SIZE) {
+      if(spectate != NULL && session->playing) {
+        publish_end(worker, session);
+      }
+
+      start_game(session, argument);
+      session->game_id = worker->games * worker_count + worker->index;
+      worker->games++;
+
+      if(spectate != NULL) {
+        publish_keyframe(worker, session);
+      }
+    } else {
+      status = PROTOCOL_BAD_REQUEST;
+    }
+  } else if(op == PROTOCOL_MOVE || op == PROTOCOL_GET) {
+    if(!session->playing) {
+      status = PROTOCOL_NO_GAME;
+    } else if(op == PROTOCOL_GET) {
+      for(int i = 0; i < BOARD_WORDS; i++) {
+        protocol_put_u32(reply + PROTOCOL_REPLY_SIZE + i * 8,
+                         (uint32_t)session->board.words[i]);
+        protocol_put_u32(reply + PROTOCOL_REPLY_SIZE + i * 8 + 4,
+                         (uint32_t)(session->board.words[i] >> 32));
+      }
+      size = PROTOCOL_BOARD_REPLY_SIZE;
+    } else if(argument > DIRECTION_RIGHT ||
+              !board_move(&session->board, argument))
+    {
+      status = argument > DIRECTION_RIGHT ? PROTOCOL_BAD_REQUEST :
+        PROTOCOL_ILLEGAL;
+    } else {
+      session->move_count++;
+      __atomic_add_fetch(&worker->moves, 1, __ATOMIC_RELAXED);
+
+      if(spectate != NULL) {
+        spectate_move(worker, session, argument);
+      }
+
+      if(board_is_solved(&session->board)) {
+        status = PROTOCOL_SOLVED;
+      }
+    }
+  } else {
+    status = PROTOCOL_BAD_REQUEST;
+  }
+
+  reply[0] = op | PROTOCOL_REPLY;
+  reply[1] = status;
+  reply[2] = session->board.blank;
+  reply[3] = session->board.size;
+  protocol_put_u32(reply + 4, session->move_count);
+
+  session->output_end += size;
+}
+
+static void
+close_session(worker_t* worker, session_t* session) {
+  if(spectate != NULL && session->playing) {
+    publish_end(worker, session);
+  }
+
+  close(session->fd);
+  slab_free(&worker->sessions, session);
+}
+
+/**
+   Writes as much pending output as the socket takes.
+
+   @return
+     False if the connection failed.
+*/
+static bool
+flush_output(session_t* session) {
+  while(session->output_start < session->output_end) {
+    ssize_t written = write(session->fd,
+                            session->output + session->output_start,
+                            session->output_end - session->output_start);
+
+    if(written < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    session->output_start += written;
+  }
+
+  session->output_start = 0;
+  session->output_end = 0;
+  return true;
+}
+
+/**
+   Reads requests and answers them, as many as there's room to reply to.
+
+   @return
+     False if the connection closed or failed.
+*/
+static bool
+read_requests(worker_t* worker, session_t* session) {
+  int     pending = session->output_end - session->output_start;
+  int     room;
+  int     offset = session->has_partial ? 1 : 0;
+  ssize_t count;
+
+  // Move unwritten replies to the front to make room for new ones.
+  memmove(session->output, session->output + session->output_start,
+          pending);
+  session->output_start = 0;
+  session->output_end = pending;
+
+  room = (SESSION_OUTPUT_SIZE - pending) / PROTOCOL_BOARD_REPLY_SIZE *
+    PROTOCOL_REQUEST_SIZE;
+  if(room == 0) {
+    return true;
+  }
+
+  worker->buffer[0] = session->partial;
+  count = read(session->fd, worker->buffer + offset,
+               min(room, READ_BUFFER_SIZE) - offset);
+
+  if(count == 0) {
+    return false;
+  } else if(count < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+
+  count += offset;
+
+  for(int i = 0; i + 1 < count; i += PROTOCOL_REQUEST_SIZE) {
+    handle_request(worker, session, worker->buffer[i],
+                   worker->buffer[i + 1]);
+  }
+
+  session->has_partial = count % PROTOCOL_REQUEST_SIZE != 0;
+  session->partial = worker->buffer[count - 1];
+
+  return flush_output(session);
+}
+
+/**
+   Listens for input only while there's room for replies, and for output
+   only while replies are waiting.
+*/
+static void
+update_interest(worker_t* worker, session_t* session) {
+  int      pending = session->output_end - session->output_start;
+  uint32_t events = 0;
+
+  if(SESSION_OUTPUT_SIZE - pending >= PROTOCOL_BOARD_REPLY_SIZE) {
+    events |= EPOLLIN;
+  }
+
+  if(pending > 0) {
+    events |= EPOLLOUT;
+  }
+
+  if(events != session->events) {
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.ptr = session;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, session->fd, &event);
+    session->events = events;
+  }
+}
+
+static void
+handle_session(worker_t* worker, session_t* session, uint32_t events) {
+  bool open = true;
+
+  if(events & EPOLLOUT) {
+    open = flush_output(session);
+  }
+
+  if(open && (events & EPOLLIN)) {
+    open = read_requests(worker, session);
+  } else if(events & (EPOLLHUP | EPOLLERR)) {
+    open = false;
+  }
+
+  if(open) {
+    update_interest(worker, session);
+  } else {
+    close_session(worker, session);
+  }
+}
+
+/**
+   Takes in connections the acceptor handed over.
+*/
+static void
+accept_handoffs(worker_t* worker) {
+  int fd;
+
+  while(read(worker->handoff[0], &fd, sizeof(fd)) == sizeof(fd)) {
+    session_t*         session = slab_alloc(&worker->sessions);
+    struct epoll_event event;
+
+    memset(session, 0, sizeof(session_t));
+    session->fd = fd;
+    session->random = session_seed(worker);
+    session->events = EPOLLIN;
+
+    event.events = EPOLLIN;
+    event.data.ptr = session;
+    if(epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+      close_session(worker, session);
+    }
+  }
+}
+
+static void*
+run_worker(void* data) {
+  worker_t*          worker = data;
+  struct epoll_event events[MAX_EVENTS];
+
+  while(!stopping) {
+    int count = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, 50);
+
+    worker->time = now();
+
+    for(int i = 0; i < count; i++) {
+      if(events[i].data.ptr == NULL) {
+        accept_handoffs(worker);
+      } else {
+        handle_session(worker, events[i].data.ptr, events[i].events);
+      }
+    }
+
+    if(spectate != NULL &&
+       worker->time - worker->last_flush >= SPECTATE_FLUSH_INTERVAL)
+    {
+      while(worker->dirty != NULL) {
+        publish_moves(worker, worker->dirty);
+      }
+
+      worker->last_flush = worker->time;
+    }
+  }
+
+  return NULL;
+}
+
+//==============================================================================
+// Main
+//==============================================================================
+
+static void
+on_signal(int signal_number) {
+  stopping = 1;
+}
+
+static bool
+set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+   Opens the listening socket, TCP on the loopback address or a Unix
+   socket if a path is given.
+*/
+static int
+open_listener(int port, const char* unix_path) {
+  int fd;
+  int result;
+
+  if(unix_path != NULL) {
+    struct sockaddr_un address;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, unix_path, sizeof(address.sun_path) - 1);
+    unlink(unix_path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    result = bind(fd, (struct sockaddr*)&address, sizeof(address));
+  } else {
+    struct sockaddr_in address;
+    int                reuse = 1;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    result = bind(fd, (struct sockaddr*)&address, sizeof(address));
+  }
+
+  if(fd < 0 || result != 0 || listen(fd, SOMAXCONN) != 0) {
+    perror("Unable to listen");
+    exit(1);
+  }
+
+  return fd;
+}
+
+/**
+   Lets the process hold as many connections as the hard limit allows.
+*/
+static void
+raise_fd_limit(void) {
+  struct rlimit limit;
+
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static void
+print_usage(void) {
+  printf("Sliding tile game server.\n"
+         "server [options]\n"
+         "\n"
+         "Options:\n"
+         "\t--(p)ort [port]     TCP port on 127.0.0.1.  Defaults to %d.\n"
+         "\t--(u)nix [path]     Listens on a Unix socket instead.\n"
+         "\t--(w)orkers [count] Number of worker threads.  Defaults to the "
+         "number of cores.\n"
+         "\t--(s)pectate [path] Publishes every game's moves to a stream "
+         "ring for\n"
+         "\t                    spectators, for example /dev/shm/games.\n",
+         PROTOCOL_DEFAULT_PORT);
+}
+
+int main(int argc, char** argv) {
+  int              port = PROTOCOL_DEFAULT_PORT;
+  const char*      unix_path = NULL;
+  const char*      spectate_path = NULL;
+  worker_t*        workers;
+  int              listener;
+  long             next_worker = 0;
+  uint64_t         last_moves = 0;
+  double           last_report;
+  struct sigaction action;
+  sigset_t         signals;
+
+  worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0)
+       && i + 1 < argc)
+    {
+      port = atoi(argv[++i]);
+    }
+
+    else if((strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--unix") == 0)
+            && i + 1 < argc)
+    {
+      unix_path = argv[++i];
+    }
+
+    else if((strcmp(argv[i], "-s") == 0 ||
+             strcmp(argv[i], "--spectate") == 0) && i + 1 < argc)
+    {
+      spectate_path = argv[++i];
+    }
+
+    else if((strcmp(argv[i], "-w") == 0 ||
+             strcmp(argv[i], "--workers") == 0) && i + 1 < argc)
+    {
+      worker_count = atol(argv[++i]);
+    }
+
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if(worker_count < 1) {
+    worker_count = 1;
+  }
+
+  raise_fd_limit();
+  listener = open_listener(port, unix_path);
+
+  if(spectate_path != NULL) {
+    spectate = stream_writer_open(spectate_path, SPECTATE_RING_SIZE);
+    if(spectate == NULL) {
+      return 1;
+    }
+  }
+
+  // Only the main thread handles signals; workers watch the flag.
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  workers = new_array(worker_t, worker_count);
+
+  for(long i = 0; i < worker_count; i++) {
+    worker_t*          worker = workers + i;
+    struct epoll_event event;
+
+    worker->index = i;
+    slab_init(&worker->sessions, sizeof(session_t));
+    worker->epoll_fd = epoll_create1(0);
+
+    if(worker->epoll_fd < 0 || pipe(worker->handoff) != 0 ||
+       !set_nonblocking(worker->handoff[0]))
+    {
+      perror("Unable to set up a worker");
+      return 1;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->handoff[0], &event);
+
+    pthread_create(&worker->thread, NULL, run_worker, worker);
+  }
+
+  pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+
+  if(unix_path != NULL) {
+    fprintf(stderr, "Listening on %s with %ld workers.\n", unix_path,
+            worker_count);
+  } else {
+    fprintf(stderr, "Listening on 127.0.0.1:%d with %ld workers.\n", port,
+            worker_count);
+  }
+
+  last_report = now();
+
+  while(!stopping) {
+    struct pollfd listen_poll = { listener, POLLIN, 0 };
+    uint64_t      moves = 0;
+    double        time;
+
+    if(poll(&listen_poll, 1, 1000) > 0) {
+      int fd = accept(listener, NULL, NULL);
+
+      if(fd >= 0) {
+        int no_delay = 1;
+
+        set_nonblocking(fd);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay,
+                   sizeof(no_delay));
+
+        if(write(workers[next_worker].handoff[1], &fd, sizeof(fd)) !=
+           sizeof(fd))
+        {
+          close(fd);
+        }
+
+        next_worker = (next_worker + 1) % worker_count;
+      }
+    }
+
+    // Reports the move rate about once a second while games are played.
+    time = now();
+    if(time - last_report < 1.0) {
+      continue;
+    }
+
+    for(long i = 0; i < worker_count; i++) {
+      moves += __atomic_load_n(&workers[i].moves, __ATOMIC_RELAXED);
+    }
+
+    if(moves != last_moves) {
+      fprintf(stderr, "%.0f moves/s\n",
+              (moves - last_moves) / (time - last_report));
+      last_moves = moves;
+    }
+
+    last_report = time;
+  }
+
+  for(long i = 0; i < worker_count; i++) {
+    worker_t* worker = workers + i;
+
+    pthread_join(worker->thread, NULL);
+
+    fprintf(stderr, "worker %ld: %llu games, %llu moves, %d open sessions\n",
+            i, (unsigned long long)worker->games,
+            (unsigned long long)worker->moves, worker->sessions.in_use);
+
+    close(worker->handoff[0]);
+    close(worker->handoff[1]);
+    close(worker->epoll_fd);
+    slab_destroy(&worker->sessions);
+  }
+
+  close(listener);
+  if(unix_path != NULL) {
+    unlink(unix_path);
+  }
+
+  // The ring file stays for any spectators still reading it.
+  if(spectate != NULL) {
+    stream_writer_close(spectate);
+  }
+
+  delete(workers);
+
+  return 0;
+}
@@ -0,0 +1,176 @@
+/**
+   @file snapcheck.c
+
+   Checks game_save and game_restore.  A game is played with random moves,
+   saved after every step and restored into a second game, which has to save
+   back to the same bytes.  Records with an unreachable board or a NaN slide
+   have to be refused.  Prints how long saving and restoring took on
+   average.
+
+   The games are drawn with the software renderer, so no window or gpu is
+   needed.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../gfx.h"
+#include "../game.h"
+#include "../profile.h"
+#include "../util.h"
+
+#define DEFAULT_COUNT 100000
+
+/** Side of the plain texture the tiles are cut from. */
+#define TEXTURE_SIZE 64
+
+/**
+   Swaps two tiles among the first three cells of a saved record, leaving
+   the empty slot alone, so no moves reach the board.  Cells are packed five
+   bits each from byte 32.
+*/
+static void
+swap_saved_tiles(uint8_t* record) {
+  uint32_t bits = record[32] | record[33] << 8 | record[34] << 16;
+  uint32_t tiles[3];
+  int      a, b;
+
+  for(int i = 0; i < 3; i++) {
+    tiles[i] = bits >> (i * 5) & 0x1f;
+  }
+
+  a = tiles[0] != 0 ? 0 : 1;
+  b = tiles[a + 1] != 0 ? a + 1 : a + 2;
+
+  bits &= ~(0x1fu << (a * 5) | 0x1fu << (b * 5));
+  bits |= tiles[a] << (b * 5) | tiles[b] << (a * 5);
+
+  record[32] = bits;
+  record[33] = bits >> 8;
+  record[34] = bits >> 16;
+}
+
+/**
+   Runs the round trips and the refusal checks on a pair of games.
+
+   @return
+     The number of failed checks.
+*/
+static int
+check_snapshots(game_t* game, game_t* copy, int count) {
+  uint8_t record[GAME_SNAPSHOT_SIZE];
+  uint8_t copied[GAME_SNAPSHOT_SIZE];
+  uint8_t bad[GAME_SNAPSHOT_SIZE];
+  double  save_time = 0.0;
+  double  restore_time = 0.0;
+  int     failures = 0;
+  // A quiet NaN, little-endian.
+  uint8_t nan[4] = { 0x00, 0x00, 0xc0, 0x7f };
+
+  for(int i = 0; i < count; i++) {
+    double start;
+    bool   restored;
+
+    game_move_random(game);
+    game_update(game, game->step_length);
+
+    start = profile_now();
+    game_save(game, record);
+    save_time += profile_now() - start;
+
+    start = profile_now();
+    restored = game_restore(copy, record);
+    restore_time += profile_now() - start;
+
+    game_save(copy, copied);
+    if(!restored || memcmp(record, copied, GAME_SNAPSHOT_SIZE) != 0) {
+      failures++;
+    }
+  }
+
+  memcpy(bad, record, GAME_SNAPSHOT_SIZE);
+  swap_saved_tiles(bad);
+  failures += game_restore(copy, bad);
+
+  // The slide is the float at offset 20.
+  memcpy(bad, record, GAME_SNAPSHOT_SIZE);
+  memcpy(bad + 20, nan, sizeof(nan));
+  failures += game_restore(copy, bad);
+
+  printf("%d snapshot round trips, %d failed checks: %.3f us to save, "
+         "%.3f us to restore on average\n", count, failures,
+         save_time * 1e6 / count, restore_time * 1e6 / count);
+
+  return failures;
+}
+
+static void
+print_usage(void) {
+  printf("Game save and restore checker.\n"
+         "snapcheck [options]\n"
+         "\n"
+         "Options:\n"
+         "\t--(s)kill [e|m|h]   Board size to check.  Defaults to e.\n"
+         "\t--(c)ount [count]   Round trips to time.  Defaults to %d.\n",
+         DEFAULT_COUNT);
+}
+
+int main(int argc, char** argv) {
+  skill_level_t  skill = SKILL_EASY;
+  int            count = DEFAULT_COUNT;
+  unsigned char* pixels;
+  texture_t*     texture;
+  game_t*        game;
+  game_t*        copy;
+  int            failures;
+
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--skill") == 0)
+       && i + 1 < argc)
+    {
+      char level = argv[++i][0];
+
+      skill = level == 'h' ? SKILL_HARD :
+        level == 'm' ? SKILL_MEDIUM : SKILL_EASY;
+    }
+
+    else if((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--count") == 0)
+            && i + 1 < argc)
+    {
+      count = atoi(argv[++i]);
+    }
+
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if(count < 1) {
+    print_usage();
+    return 1;
+  }
+
+  if(!gfx_init("snapcheck", SCREEN_WIDTH, SCREEN_HEIGHT,
+               GFX_RENDERER_SOFTWARE))
+  {
+    printf("Cannot start the software renderer\n");
+    return 1;
+  }
+
+  // The tiles only need something to be cut from.
+  pixels = new_array(unsigned char, TEXTURE_SIZE * TEXTURE_SIZE * 4);
+  texture = texture_create(pixels, TEXTURE_SIZE, TEXTURE_SIZE, true);
+  delete(pixels);
+
+  game = game_new(skill, texture);
+  copy = game_new(skill, texture);
+
+  failures = check_snapshots(game, copy, count);
+
+  game_end(copy);
+  game_end(game);
+  gfx_shutdown();
+
+  return failures == 0 ? 0 : 1;
+}
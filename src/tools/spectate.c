@@ -0,0 +1,467 @@
+/**
+   @file spectate.c
+
+   Follows the games a server publishes to a stream ring (stream.h),
+   rebuilding every board from keyframes and moves.
+
+   By default it reports once a second how many games it follows and how
+   many bytes of stream they take.  With --game it prints one game's board
+   whenever it changes.  With --viewers it runs a fan-out benchmark instead:
+   that many viewers, each on its own thread with its own reader, follow
+   every game for a while, as separate spectator processes would.
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../board.h"
+#include "../util.h"
+#include "stream.h"
+
+#define VIEWER_STACK_SIZE (128 * 1024)
+
+/** Nanoseconds a viewer waits when it has caught up with the stream. */
+#define VIEWER_POLL_INTERVAL 10000000
+
+/** Starting size of a viewer's table of games.  Always a power of two. */
+#define FIRST_TABLE_SIZE 256
+
+typedef enum slot_state {
+  SLOT_EMPTY,
+  SLOT_USED,
+  /** Held a game that ended.  Searches carry on past it. */
+  SLOT_REMOVED
+} slot_state_t;
+
+typedef struct followed_game {
+  slot_state_t state;
+  uint64_t     game;
+  board_t      board;
+  uint32_t     move_count;
+} followed_game_t;
+
+typedef struct viewer {
+  pthread_t        thread;
+  stream_reader_t* reader;
+
+  /** Open addressed table of the games being followed. */
+  followed_game_t* games;
+  int              table_size;
+  int              used;
+  int              removed;
+  uint64_t         laps_seen;
+
+  uint64_t         records;
+  uint64_t         moves;
+  /** Moves that didn't apply, or keyframes that disagreed with a board. */
+  uint64_t         mismatches;
+} viewer_t;
+
+static volatile sig_atomic_t stopping = 0;
+
+static double
+now(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void
+on_signal(int signal_number) {
+  stopping = 1;
+}
+
+//==============================================================================
+// Following games
+//==============================================================================
+
+static followed_game_t*
+find_slot(viewer_t* viewer, uint64_t game, bool adding) {
+  uint32_t         mask = viewer->table_size - 1;
+  uint32_t         index = (uint32_t)(game * 0x9e3779b97f4a7c15ull >> 32) &
+    mask;
+  followed_game_t* reusable = NULL;
+
+  while(true) {
+    followed_game_t* slot = viewer->games + index;
+
+    if(slot->state == SLOT_EMPTY) {
+      return adding && reusable != NULL ? reusable :
+        (adding ? slot : NULL);
+    } else if(slot->state == SLOT_USED && slot->game == game) {
+      return slot;
+    } else if(slot->state == SLOT_REMOVED && reusable == NULL) {
+      reusable = slot;
+    }
+
+    index = (index + 1) & mask;
+  }
+}
+
+static void
+clear_games(viewer_t* viewer, int table_size) {
+  delete(viewer->games);
+
+  viewer->games = new_array(followed_game_t, table_size);
+  viewer->table_size = table_size;
+  viewer->used = 0;
+  viewer->removed = 0;
+}
+
+/**
+   Keeps the table under half full, counting removed slots.
+*/
+static void
+make_room(viewer_t* viewer) {
+  followed_game_t* old = viewer->games;
+  int              old_size = viewer->table_size;
+  int              size = old_size;
+
+  if((viewer->used + viewer->removed + 1) * 2 <= old_size) {
+    return;
+  }
+
+  if((viewer->used + 1) * 4 > old_size) {
+    size *= 2;
+  }
+
+  viewer->games = new_array(followed_game_t, size);
+  viewer->table_size = size;
+  viewer->used = 0;
+  viewer->removed = 0;
+
+  for(int i = 0; i < old_size; i++) {
+    if(old[i].state == SLOT_USED) {
+      *find_slot(viewer, old[i].game, true) = old[i];
+      viewer->used++;
+    }
+  }
+
+  delete(old);
+}
+
+/**
+   Applies a record to the boards being followed.
+
+   @return
+     The game the record was about, or NULL if it isn't followed.
+*/
+static followed_game_t*
+apply_record(viewer_t* viewer, const stream_record_t* record) {
+  followed_game_t* game = find_slot(viewer, record->game, false);
+
+  viewer->records++;
+
+  if(record->kind == STREAM_KEYFRAME) {
+    if(game == NULL) {
+      make_room(viewer);
+      game = find_slot(viewer, record->game, true);
+
+      if(game->state == SLOT_REMOVED) {
+        viewer->removed--;
+      }
+
+      game->state = SLOT_USED;
+      game->game = record->game;
+      viewer->used++;
+    } else if(memcmp(game->board.words, record->board.words,
+                     sizeof(game->board.words)) != 0 ||
+              game->move_count != record->move_count)
+    {
+      viewer->mismatches++;
+    }
+
+    game->board = record->board;
+    game->move_count = record->move_count;
+  } else if(record->kind == STREAM_MOVES && game != NULL) {
+    for(int i = 0; i < record->count; i++) {
+      if(!board_move(&game->board, record->directions[i])) {
+        viewer->mismatches++;
+      }
+    }
+
+    game->move_count += record->count;
+    viewer->moves += record->count;
+  } else if(record->kind == STREAM_END && game != NULL) {
+    game->state = SLOT_REMOVED;
+    viewer->used--;
+    viewer->removed++;
+    game = NULL;
+  }
+
+  return game;
+}
+
+/**
+   Applies every record written since the last call.
+
+   @return
+     Number of records applied.
+*/
+static int
+follow(viewer_t* viewer, uint64_t watched_game) {
+  stream_record_t record;
+  int             count = 0;
+
+  while(stream_next(viewer->reader, &record)) {
+    followed_game_t* game;
+
+    // After a lap, moves may have been missed, so start again from
+    // keyframes.
+    if(viewer->reader->laps != viewer->laps_seen) {
+      viewer->laps_seen = viewer->reader->laps;
+      clear_games(viewer, viewer->table_size);
+    }
+
+    game = apply_record(viewer, &record);
+    count++;
+
+    if(game != NULL && game->game == watched_game) {
+      char text[BOARD_MAX_CELLS * 3 + 1];
+
+      board_format(&game->board, text, sizeof(text));
+      printf("%llu moves: %s%s\n", (unsigned long long)game->move_count,
+             text, board_is_solved(&game->board) ? " (solved)" : "");
+    }
+  }
+
+  return count;
+}
+
+static void
+sleep_briefly(void) {
+  struct timespec pause = { 0, VIEWER_POLL_INTERVAL };
+
+  nanosleep(&pause, NULL);
+}
+
+static bool
+open_viewer(viewer_t* viewer, const char* path) {
+  memset(viewer, 0, sizeof(viewer_t));
+
+  viewer->reader = stream_reader_open(path);
+  clear_games(viewer, FIRST_TABLE_SIZE);
+
+  return viewer->reader != NULL;
+}
+
+static void
+close_viewer(viewer_t* viewer) {
+  if(viewer->reader != NULL) {
+    stream_reader_close(viewer->reader);
+  }
+
+  delete(viewer->games);
+}
+
+//==============================================================================
+// Modes
+//==============================================================================
+
+static void*
+run_viewer(void* data) {
+  viewer_t* viewer = data;
+
+  while(!stopping) {
+    if(follow(viewer, UINT64_MAX) == 0) {
+      sleep_briefly();
+    }
+  }
+
+  return NULL;
+}
+
+/**
+   Runs many viewers at once and reports how well they kept up.
+*/
+static int
+run_benchmark(const char* path, int viewer_count, double seconds) {
+  viewer_t*      viewers = new_array(viewer_t, viewer_count);
+  pthread_attr_t attributes;
+  uint64_t       records = 0;
+  uint64_t       moves = 0;
+  uint64_t       mismatches = 0;
+  uint64_t       slowest = UINT64_MAX;
+  uint64_t       backlog = 0;
+  int            lapped = 0;
+  int            started = 0;
+  double         start = now();
+  double         elapsed;
+
+  pthread_attr_init(&attributes);
+  pthread_attr_setstacksize(&attributes, VIEWER_STACK_SIZE);
+
+  for(int i = 0; i < viewer_count; i++) {
+    if(!open_viewer(viewers + i, path) ||
+       pthread_create(&viewers[i].thread, &attributes, run_viewer,
+                      viewers + i) != 0)
+    {
+      logmsg("Unable to start viewer %d.", i);
+      break;
+    }
+
+    started++;
+  }
+
+  while(!stopping && now() - start < seconds) {
+    sleep_briefly();
+  }
+
+  stopping = 1;
+  elapsed = now() - start;
+
+  for(int i = 0; i < started; i++) {
+    pthread_join(viewers[i].thread, NULL);
+
+    records += viewers[i].records;
+    moves += viewers[i].moves;
+    mismatches += viewers[i].mismatches;
+    slowest = viewers[i].moves < slowest ? viewers[i].moves : slowest;
+    lapped += viewers[i].reader->laps > 0;
+    if(stream_backlog(viewers[i].reader) > backlog) {
+      backlog = stream_backlog(viewers[i].reader);
+    }
+  }
+
+  printf("%d viewers for %.1f s: %.0f records/s, %.0f moves/s applied in "
+         "total\n", started, elapsed, records / elapsed, moves / elapsed);
+  printf("per viewer: %.0f moves/s average, %.0f moves/s slowest\n",
+         started > 0 ? moves / elapsed / started : 0.0,
+         started > 0 ? slowest / elapsed : 0.0);
+  printf("%d viewers fell a ring behind, %llu bytes most left unread, "
+         "%llu mismatches\n", lapped, (unsigned long long)backlog,
+         (unsigned long long)mismatches);
+
+  for(int i = 0; i < viewer_count; i++) {
+    close_viewer(viewers + i);
+  }
+
+  pthread_attr_destroy(&attributes);
+  delete(viewers);
+
+  return started < viewer_count || mismatches > 0;
+}
+
+/**
+   Follows the stream on this thread, printing a report each second or the
+   watched game as it changes.
+*/
+static int
+run_single(const char* path, uint64_t watched_game, double seconds) {
+  viewer_t viewer;
+  double   start = now();
+  double   last_report = start;
+  uint64_t last_position;
+  uint64_t last_moves = 0;
+
+  if(!open_viewer(&viewer, path)) {
+    close_viewer(&viewer);
+    return 1;
+  }
+
+  last_position = viewer.reader->position;
+
+  while(!stopping && (seconds <= 0 || now() - start < seconds)) {
+    double time;
+
+    if(follow(&viewer, watched_game) == 0) {
+      sleep_briefly();
+    }
+
+    time = now();
+    if(watched_game == UINT64_MAX && time - last_report >= 1.0) {
+      double rate = (viewer.reader->position - last_position) /
+        (time - last_report);
+
+      printf("%d games, %.0f moves/s, %.0f bytes/s, %.1f bytes/s per game\n",
+             viewer.used, (viewer.moves - last_moves) / (time - last_report),
+             rate, viewer.used > 0 ? rate / viewer.used : 0.0);
+      fflush(stdout);
+
+      last_report = time;
+      last_position = viewer.reader->position;
+      last_moves = viewer.moves;
+    }
+  }
+
+  if(viewer.mismatches > 0) {
+    printf("%llu mismatches\n", (unsigned long long)viewer.mismatches);
+  }
+
+  close_viewer(&viewer);
+  return viewer.mismatches > 0;
+}
+
+static void
+print_usage(void) {
+  printf("Follows games published by the server.\n"
+         "spectate [options] ring\n"
+         "\n"
+         "Options:\n"
+         "\t--(g)ame [id]        Prints one game's board as it changes.\n"
+         "\t--(v)iewers [count]  Runs a benchmark with that many viewers.\n"
+         "\t--(s)econds [time]   Stops after this long.  Benchmarks default "
+         "to 10.\n");
+}
+
+int main(int argc, char** argv) {
+  const char*      path = NULL;
+  uint64_t         watched_game = UINT64_MAX;
+  int              viewer_count = 0;
+  double           seconds = 0;
+  struct sigaction action;
+
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "--game") == 0)
+       && i + 1 < argc)
+    {
+      watched_game = strtoull(argv[++i], NULL, 10);
+    }
+
+    else if((strcmp(argv[i], "-v") == 0 ||
+             strcmp(argv[i], "--viewers") == 0) && i + 1 < argc)
+    {
+      viewer_count = atoi(argv[++i]);
+    }
+
+    else if((strcmp(argv[i], "-s") == 0 ||
+             strcmp(argv[i], "--seconds") == 0) && i + 1 < argc)
+    {
+      seconds = atof(argv[++i]);
+    }
+
+    else if(argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    }
+
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if(path == NULL) {
+    print_usage();
+    return 1;
+  }
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  if(viewer_count > 0) {
+    return run_benchmark(path, viewer_count, seconds > 0 ? seconds : 10);
+  }
+
+  return run_single(path, watched_game, seconds);
+}
@@ -0,0 +1,621 @@
+/**
+   @file statespace.c
+
+   Enumerates the complete state space of small sliding tile boards using a
+   disk based breadth-first search.  Each BFS layer is kept on disk as a
+   sorted file of permutation ranks.  Neighbors of a layer are generated in
+   memory sized chunks, sorted and written out as runs, and the runs are then
+   merged against the previous and current layer files to throw away
+   duplicates.  Only the chunk buffers live in memory so even the 3x4 board
+   (239 million states) runs in a fixed amount of RAM.
+
+   The goal state matches the game: the empty slot is the upper left-hand
+   corner and tile n belongs at cell n in row-major order.
+
+   For each board the tool writes:
+     - WxH.hist: "depth count" lines for every depth of the search.
+     - WxH.dist: one byte per permutation rank holding depth + 1, or 0 when
+       the permutation is not reachable from the goal.
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../util.h"
+
+/** Largest board (in cells) whose permutation rank fits in 32 bits. */
+#define MAX_CELLS 12
+
+/** Deepest layer the histogram can hold. */
+#define MAX_DEPTH 128
+
+#define DEFAULT_MEMORY_MB 256
+
+typedef struct board_shape {
+  int width;
+  int height;
+  int cells;
+} board_shape_t;
+
+/**
+   Reads a sorted stream of ranks from a layer or run file.
+*/
+typedef struct rank_stream {
+  FILE*    file;
+  uint32_t current;
+  bool     valid;
+} rank_stream_t;
+
+static uint32_t factorials[MAX_CELLS + 1];
+
+//==============================================================================
+// Permutation ranking
+//==============================================================================
+
+static void
+init_factorials(void) {
+  factorials[0] = 1;
+
+  for(int i = 1; i <= MAX_CELLS; i++) {
+    factorials[i] = factorials[i - 1] * i;
+  }
+}
+
+/**
+   Lexicographic rank of a permutation of [0, n).
+*/
+static uint32_t
+rank_permutation(const uint8_t* perm, int n) {
+  uint32_t rank = 0;
+  uint32_t used = 0;
+
+  for(int i = 0; i < n; i++) {
+    uint32_t below = used & ((1u << perm[i]) - 1);
+
+    rank += (perm[i] - __builtin_popcount(below)) * factorials[n - 1 - i];
+    used |= 1u << perm[i];
+  }
+
+  return rank;
+}
+
+static void
+unrank_permutation(uint32_t rank, uint8_t* perm, int n) {
+  uint32_t used = 0;
+
+  for(int i = 0; i < n; i++) {
+    uint32_t index = rank / factorials[n - 1 - i];
+    int      value = 0;
+
+    rank %= factorials[n - 1 - i];
+
+    // Find the index'th unused value
+    for(;; value++) {
+      if(!(used & (1u << value))) {
+        if(index == 0) {
+          break;
+        }
+        index--;
+      }
+    }
+
+    perm[i] = value;
+    used |= 1u << value;
+  }
+}
+
+//==============================================================================
+// Sorting and streams
+//==============================================================================
+
+/**
+   LSD radix sort of 32-bit ranks.  The result ends up back in values.
+*/
+static void
+radix_sort(uint32_t* values, uint32_t* scratch, size_t count) {
+  for(int shift = 0; shift < 32; shift += 8) {
+    size_t offsets[256] = { 0 };
+    size_t total = 0;
+
+    for(size_t i = 0; i < count; i++) {
+      offsets[(values[i] >> shift) & 0xFF]++;
+    }
+
+    for(int b = 0; b < 256; b++) {
+      size_t bucket = offsets[b];
+      offsets[b] = total;
+      total += bucket;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+      scratch[offsets[(values[i] >> shift) & 0xFF]++] = values[i];
+    }
+
+    memcpy(values, scratch, count * sizeof(uint32_t));
+  }
+}
+
+static void
+stream_next(rank_stream_t* stream) {
+  stream->valid = stream->file != NULL &&
+    fread(&stream->current, sizeof(uint32_t), 1, stream->file) == 1;
+
+  // A short count has to be the end of the file, or the layer counts are
+  // silently wrong.
+  if(!stream->valid && stream->file != NULL && ferror(stream->file)) {
+    logmsg("Unable to read a layer or run file.");
+    exit(1);
+  }
+}
+
+/**
+   Opens a rank stream.  The file has to exist.
+*/
+static void
+stream_open(rank_stream_t* stream, const char* path) {
+  stream->file = fopen(path, "rb");
+  if(stream->file == NULL) {
+    logmsg("Unable to open %s.", path);
+    exit(1);
+  }
+  stream_next(stream);
+}
+
+/**
+   Sets up a stream with nothing in it, for the layer before the first.
+*/
+static void
+stream_open_empty(rank_stream_t* stream) {
+  stream->file = NULL;
+  stream->valid = false;
+}
+
+static void
+stream_close(rank_stream_t* stream) {
+  if(stream->file != NULL) {
+    fclose(stream->file);
+    stream->file = NULL;
+  }
+}
+
+/**
+   Advances the stream up to value and reports whether it holds value.
+*/
+static bool
+stream_contains(rank_stream_t* stream, uint32_t value) {
+  while(stream->valid && stream->current < value) {
+    stream_next(stream);
+  }
+
+  return stream->valid && stream->current == value;
+}
+
+static void
+layer_path(char* path, size_t size, const char* dir, board_shape_t* shape,
+           int depth)
+{
+  snprintf(path, size, "%s/%dx%d.layer.%d", dir, shape->width, shape->height,
+           depth);
+}
+
+static void
+run_path(char* path, size_t size, const char* dir, board_shape_t* shape,
+         int run)
+{
+  snprintf(path, size, "%s/%dx%d.run.%d", dir, shape->width, shape->height,
+           run);
+}
+
+//==============================================================================
+// Search
+//==============================================================================
+
+/**
+   Sorts, de-duplicates and writes out one chunk of neighbors as a run file.
+*/
+static void
+flush_run(uint32_t* chunk, uint32_t* scratch, size_t count, const char* path) {
+  FILE*  file;
+  size_t unique = 0;
+
+  radix_sort(chunk, scratch, count);
+
+  for(size_t i = 0; i < count; i++) {
+    if(unique == 0 || chunk[unique - 1] != chunk[i]) {
+      chunk[unique++] = chunk[i];
+    }
+  }
+
+  file = fopen(path, "wb");
+  if(file == NULL || fwrite(chunk, sizeof(uint32_t), unique, file) != unique) {
+    logmsg("Unable to write run file %s.", path);
+    exit(1);
+  }
+  fclose(file);
+}
+
+/**
+   Generates every neighbor of the states in a layer file into sorted runs.
+
+   @return
+     The number of run files written.
+*/
+static int
+expand_layer(board_shape_t* shape, const char* dir, int depth,
+             uint32_t* chunk, uint32_t* scratch, size_t capacity)
+{
+  char          path[512];
+  rank_stream_t layer;
+  size_t        count = 0;
+  int           runs = 0;
+  uint8_t       perm[MAX_CELLS];
+
+  layer_path(path, sizeof(path), dir, shape, depth);
+  stream_open(&layer, path);
+
+  for(; layer.valid; stream_next(&layer)) {
+    int blank = 0;
+    int bx, by;
+
+    unrank_permutation(layer.current, perm, shape->cells);
+    while(perm[blank] != 0) {
+      blank++;
+    }
+    bx = blank % shape->width;
+    by = blank / shape->width;
+
+    int neighbors[4] = {
+      bx > 0                  ? blank - 1            : -1,
+      bx < shape->width - 1   ? blank + 1            : -1,
+      by > 0                  ? blank - shape->width : -1,
+      by < shape->height - 1  ? blank + shape->width : -1
+    };
+
+    if(count + 4 > capacity) {
+      run_path(path, sizeof(path), dir, shape, runs++);
+      flush_run(chunk, scratch, count, path);
+      count = 0;
+    }
+
+    for(int i = 0; i < 4; i++) {
+      int cell = neighbors[i];
+
+      if(cell >= 0) {
+        perm[blank] = perm[cell];
+        perm[cell] = 0;
+
+        chunk[count++] = rank_permutation(perm, shape->cells);
+
+        perm[cell] = perm[blank];
+        perm[blank] = 0;
+      }
+    }
+  }
+
+  if(count > 0) {
+    run_path(path, sizeof(path), dir, shape, runs++);
+    flush_run(chunk, scratch, count, path);
+  }
+
+  stream_close(&layer);
+  return runs;
+}
+
+/**
+   Restores the min-heap of run indices (ordered by each run's current rank)
+   below index i.
+*/
+static void
+heap_sift_down(int* heap, int heap_size, rank_stream_t* runs, int i) {
+  for(;;) {
+    int smallest = i;
+    int left = i * 2 + 1;
+    int right = left + 1;
+    int swap;
+
+    if(left < heap_size &&
+       runs[heap[left]].current < runs[heap[smallest]].current) {
+      smallest = left;
+    }
+    if(right < heap_size &&
+       runs[heap[right]].current < runs[heap[smallest]].current) {
+      smallest = right;
+    }
+    if(smallest == i) {
+      break;
+    }
+
+    swap = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = swap;
+    i = smallest;
+  }
+}
+
+/**
+   K-way merges the run files into the next layer, dropping anything already
+   in the previous or current layer.  Every new state is recorded in the
+   distance table.
+
+   @return
+     Number of states in the new layer.
+*/
+static uint64_t
+merge_runs(board_shape_t* shape, const char* dir, int depth, int run_count,
+           uint8_t* table)
+{
+  char           path[512];
+  rank_stream_t* runs = new_array(rank_stream_t, run_count);
+  int*           heap = new_array(int, run_count);
+  int            heap_size = 0;
+  rank_stream_t  previous;
+  rank_stream_t  current;
+  FILE*          next;
+  uint64_t       written = 0;
+  uint32_t       last = 0;
+
+  if(depth > 0) {
+    layer_path(path, sizeof(path), dir, shape, depth - 1);
+    stream_open(&previous, path);
+  } else {
+    stream_open_empty(&previous);
+  }
+  layer_path(path, sizeof(path), dir, shape, depth);
+  stream_open(&current, path);
+
+  layer_path(path, sizeof(path), dir, shape, depth + 1);
+  next = fopen(path, "wb");
+  if(next == NULL) {
+    logmsg("Unable to create layer file %s.", path);
+    exit(1);
+  }
+
+  for(int i = 0; i < run_count; i++) {
+    run_path(path, sizeof(path), dir, shape, i);
+    stream_open(runs + i, path);
+
+    if(runs[i].valid) {
+      heap[heap_size++] = i;
+    }
+  }
+
+  for(int i = heap_size / 2 - 1; i >= 0; i--) {
+    heap_sift_down(heap, heap_size, runs, i);
+  }
+
+  while(heap_size > 0) {
+    rank_stream_t* top = runs + heap[0];
+    uint32_t       value = top->current;
+
+    if((written == 0 || value != last) &&
+       !stream_contains(&previous, value) &&
+       !stream_contains(&current, value))
+    {
+      fwrite(&value, sizeof(uint32_t), 1, next);
+      table[value] = (uint8_t)(depth + 2);
+      written++;
+    }
+    last = value;
+
+    stream_next(top);
+    if(!top->valid) {
+      heap[0] = heap[--heap_size];
+    }
+
+    heap_sift_down(heap, heap_size, runs, 0);
+  }
+
+  fclose(next);
+  stream_close(&previous);
+  stream_close(&current);
+
+  for(int i = 0; i < run_count; i++) {
+    stream_close(runs + i);
+    run_path(path, sizeof(path), dir, shape, i);
+    remove(path);
+  }
+
+  delete(heap);
+  delete(runs);
+
+  return written;
+}
+
+/**
+   Runs the complete search for a board and writes the histogram and
+   distance table.
+*/
+static bool
+enumerate_board(board_shape_t* shape, const char* dir, size_t memory_bytes) {
+  char      path[512];
+  uint64_t  histogram[MAX_DEPTH] = { 0 };
+  uint64_t  total = 1;
+  uint8_t   goal[MAX_CELLS];
+  uint32_t  goal_rank;
+  size_t    table_size = factorials[shape->cells];
+  size_t    capacity = memory_bytes / (2 * sizeof(uint32_t));
+  uint32_t* chunk;
+  uint32_t* scratch;
+  uint8_t*  table;
+  FILE*     file;
+  int       fd;
+  int       depth = 0;
+
+  // The distance table is memory mapped so the OS pages it rather than
+  // keeping up to 479MB resident.
+  snprintf(path, sizeof(path), "%s/%dx%d.dist", dir, shape->width,
+           shape->height);
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, table_size) != 0) {
+    logmsg("Unable to create distance table %s.", path);
+    return false;
+  }
+
+  table = mmap(NULL, table_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(table == MAP_FAILED) {
+    logmsg("Unable to map distance table %s.", path);
+    close(fd);
+    return false;
+  }
+
+  chunk = new_array(uint32_t, capacity);
+  scratch = new_array(uint32_t, capacity);
+
+  for(int i = 0; i < shape->cells; i++) {
+    goal[i] = i;
+  }
+  goal_rank = rank_permutation(goal, shape->cells);
+  table[goal_rank] = 1;
+  histogram[0] = 1;
+
+  layer_path(path, sizeof(path), dir, shape, 0);
+  file = fopen(path, "wb");
+  if(file == NULL || fwrite(&goal_rank, sizeof(uint32_t), 1, file) != 1) {
+    logmsg("Unable to create layer file %s.", path);
+    exit(1);
+  }
+  fclose(file);
+
+  while(histogram[depth] > 0 && depth + 1 < MAX_DEPTH) {
+    int runs = expand_layer(shape, dir, depth, chunk, scratch, capacity);
+
+    histogram[depth + 1] = merge_runs(shape, dir, depth, runs, table);
+    total += histogram[depth + 1];
+
+    layer_path(path, sizeof(path), dir, shape, depth - 1);
+    remove(path);
+
+    depth++;
+    if(histogram[depth] > 0) {
+      printf("%dx%d depth %d: %llu\n", shape->width, shape->height, depth,
+             (unsigned long long)histogram[depth]);
+      fflush(stdout);
+    }
+  }
+
+  layer_path(path, sizeof(path), dir, shape, depth - 1);
+  remove(path);
+  layer_path(path, sizeof(path), dir, shape, depth);
+  remove(path);
+
+  munmap(table, table_size);
+  close(fd);
+  delete(chunk);
+  delete(scratch);
+
+  // Histogram
+  snprintf(path, sizeof(path), "%s/%dx%d.hist", dir, shape->width,
+           shape->height);
+  file = fopen(path, "wt");
+  if(file == NULL) {
+    logmsg("Unable to write histogram %s.", path);
+    return false;
+  }
+
+  for(int d = 0; d < depth; d++) {
+    fprintf(file, "%d %llu\n", d, (unsigned long long)histogram[d]);
+  }
+  fclose(file);
+
+  printf("%dx%d: %llu states, max depth %d\n", shape->width, shape->height,
+         (unsigned long long)total, depth - 1);
+
+  return true;
+}
+
+//==============================================================================
+// Main
+//==============================================================================
+
+static void
+print_usage(void) {
+  printf("Sliding tile state space enumerator.\n"
+         "statespace [options] [WxH ...]\n"
+         "\n"
+         "Boards default to 2x3 3x2 3x3 3x4 4x3.\n"
+         "\n"
+         "Options:\n"
+         "\t--(d)ir [path]     Directory for layer files and output.\n"
+         "\t--(m)emory [MB]    Memory budget for neighbor chunks, at least "
+         "1.\n");
+}
+
+int main(int argc, char** argv) {
+  const char*   default_boards[] = { "2x3", "3x2", "3x3", "3x4", "4x3" };
+  const char**  boards;
+  int           board_count = 0;
+  const char*   dir = ".";
+  size_t        memory_mb = DEFAULT_MEMORY_MB;
+  bool          result = true;
+
+  boards = new_array(const char*, argc + 5);
+
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--dir") == 0)
+       && i + 1 < argc)
+    {
+      dir = argv[++i];
+    }
+
+    else if((strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--memory") == 0)
+            && i + 1 < argc)
+    {
+      char* end;
+
+      // A zero budget leaves no room for even one state's neighbors in a
+      // chunk, and strtoul reads garbage as zero.
+      memory_mb = strtoul(argv[++i], &end, 10);
+      if(*end != '\0' || end == argv[i] || memory_mb < 1 ||
+         memory_mb > SIZE_MAX / (1024 * 1024))
+      {
+        printf("Invalid memory budget %s.  It must be a whole number of "
+               "megabytes, at least 1.\n", argv[i]);
+        delete(boards);
+        return 1;
+      }
+    }
+
+    else if(strchr(argv[i], 'x') != NULL && argv[i][0] != '-') {
+      boards[board_count++] = argv[i];
+    }
+
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if(board_count == 0) {
+    memcpy(boards, default_boards, sizeof(default_boards));
+    board_count = 5;
+  }
+
+  init_factorials();
+
+  for(int i = 0; i < board_count && result; i++) {
+    board_shape_t shape;
+
+    if(sscanf(boards[i], "%dx%d", &shape.width, &shape.height) != 2 ||
+       shape.width < 2 || shape.height < 2 ||
+       shape.width * shape.height > MAX_CELLS)
+    {
+      printf("Invalid board %s.  Boards must be at least 2x2 and at most %d "
+             "cells.\n", boards[i], MAX_CELLS);
+      result = false;
+    } else {
+      shape.cells = shape.width * shape.height;
+      result = enumerate_board(&shape, dir, memory_mb * 1024 * 1024);
+    }
+  }
+
+  delete(boards);
+
+  return result ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../util.h"
+#include "stream.h"
+
+#define STREAM_MAGIC 0x4d525453
+
+/**
+   Layout of a ring file.  Positions count every byte ever written, so the
+   offset into data is the position modulo the capacity.
+*/
+struct stream_ring {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+  /** CLOCK_MONOTONIC nanoseconds when the ring was created. */
+  uint64_t epoch;
+
+  /**
+      Position the writer may have written up to.  Raised before bytes are
+      overwritten, so readers can tell if what they copied was changed.
+  */
+  uint64_t reserved;
+  /** Position up to which whole records are written. */
+  uint64_t written;
+  /** Position of the newest whole record, where lapped readers restart. */
+  uint64_t last_record;
+
+  uint8_t  data[];
+};
+
+//==============================================================================
+// Records
+//==============================================================================
+
+static size_t
+put_varint(uint8_t* buffer, uint64_t value) {
+  size_t size = 0;
+
+  while(value >= 0x80) {
+    buffer[size++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+
+  buffer[size++] = value;
+  return size;
+}
+
+/**
+   @return
+     Bytes read, or 0 if the buffer ends inside the number.
+*/
+static size_t
+get_varint(const uint8_t* buffer, size_t size, uint64_t* value) {
+  *value = 0;
+
+  for(size_t i = 0; i < size && i < 10; i++) {
+    *value |= (uint64_t)(buffer[i] & 0x7f) << (i * 7);
+
+    if((buffer[i] & 0x80) == 0) {
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+size_t
+stream_encode(const stream_record_t* record, uint8_t* buffer) {
+  size_t size = 1;
+
+  buffer[0] = record->kind;
+
+  if(record->kind == STREAM_PAD) {
+    return size;
+  }
+
+  if(record->kind == STREAM_MOVES) {
+    buffer[0] |= (record->count - 1) << 2;
+  }
+
+  size += put_varint(buffer + size, record->game);
+
+  if(record->kind == STREAM_MOVES) {
+    memset(buffer + size, 0, (record->count + 3) / 4);
+
+    for(int i = 0; i < record->count; i++) {
+      buffer[size + i / 4] |= (record->directions[i] & 3) << (i % 4 * 2);
+    }
+
+    size += (record->count + 3) / 4;
+
+    for(int i = 0; i < record->count; i++) {
+      size += put_varint(buffer + size, record->delays[i]);
+    }
+  } else if(record->kind == STREAM_KEYFRAME) {
+    int      cells = record->board.size * record->board.size;
+    uint32_t bits = 0;
+    int      bit_count = 0;
+
+    size += put_varint(buffer + size, record->time);
+    size += put_varint(buffer + size, record->move_count);
+    buffer[size++] = record->board.size;
+
+    for(int i = 0; i < cells; i++) {
+      bits |= board_get(&record->board, i) << bit_count;
+      bit_count += 5;
+
+      while(bit_count >= 8) {
+        buffer[size++] = bits;
+        bits >>= 8;
+        bit_count -= 8;
+      }
+    }
+
+    if(bit_count > 0) {
+      buffer[size++] = bits;
+    }
+  }
+
+  return size;
+}
+
+size_t
+stream_decode(const uint8_t* buffer, size_t size, stream_record_t* record) {
+  size_t   used = 1;
+  size_t   count;
+  uint64_t value;
+
+  if(size == 0) {
+    return 0;
+  }
+
+  record->kind = buffer[0] & 3;
+
+  if(record->kind == STREAM_PAD) {
+    return used;
+  }
+
+  if((count = get_varint(buffer + used, size - used, &record->game)) == 0) {
+    return 0;
+  }
+  used += count;
+
+  if(record->kind == STREAM_MOVES) {
+    record->count = (buffer[0] >> 2) + 1;
+
+    if(used + (record->count + 3) / 4 > size) {
+      return 0;
+    }
+
+    for(int i = 0; i < record->count; i++) {
+      record->directions[i] = (buffer[used + i / 4] >> (i % 4 * 2)) & 3;
+    }
+    used += (record->count + 3) / 4;
+
+    for(int i = 0; i < record->count; i++) {
+      if((count = get_varint(buffer + used, size - used, &value)) == 0) {
+        return 0;
+      }
+
+      record->delays[i] = value;
+      used += count;
+    }
+  } else if(record->kind == STREAM_KEYFRAME) {
+    int      cells;
+    uint32_t bits = 0;
+    int      bit_count = 0;
+
+    if((count = get_varint(buffer + used, size - used, &record->time)) == 0) {
+      return 0;
+    }
+    used += count;
+
+    if((count = get_varint(buffer + used, size - used, &value)) == 0 ||
+       used + count >= size)
+    {
+      return 0;
+    }
+    record->move_count = value;
+    used += count;
+
+    if(!board_init(&record->board, buffer[used++])) {
+      return 0;
+    }
+
+    cells = record->board.size * record->board.size;
+    if(used + (cells * 5 + 7) / 8 > size) {
+      return 0;
+    }
+
+    for(int i = 0; i < cells; i++) {
+      int tile;
+
+      if(bit_count < 5) {
+        bits |= buffer[used++] << bit_count;
+        bit_count += 8;
+      }
+
+      tile = bits & 0x1f;
+      bits >>= 5;
+      bit_count -= 5;
+
+      if(tile >= cells) {
+        return 0;
+      }
+
+      board_set(&record->board, i, tile);
+      if(tile == 0) {
+        record->board.blank = i;
+      }
+    }
+  }
+
+  return used;
+}
+
+//==============================================================================
+// Ring
+//==============================================================================
+
+static uint64_t
+monotonic_nanoseconds(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+uint64_t
+stream_time(const stream_ring_t* ring) {
+  return (monotonic_nanoseconds() - ring->epoch) / 1000000;
+}
+
+stream_writer_t*
+stream_writer_open(const char* path, size_t capacity) {
+  stream_writer_t* writer;
+  stream_ring_t*   ring;
+  size_t           ring_capacity = 4096;
+  size_t           mapped_size;
+  int              fd;
+
+  while(ring_capacity < capacity) {
+    ring_capacity *= 2;
+  }
+
+  mapped_size = sizeof(stream_ring_t) + ring_capacity;
+
+  unlink(path);
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    logmsg("Unable to create stream ring %s.", path);
+    return NULL;
+  }
+
+  if(ftruncate(fd, mapped_size) != 0) {
+    logmsg("Unable to size stream ring %s.", path);
+    close(fd);
+    return NULL;
+  }
+
+  ring = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(ring == MAP_FAILED) {
+    logmsg("Unable to map stream ring %s.", path);
+    return NULL;
+  }
+
+  ring->version = 1;
+  ring->capacity = ring_capacity;
+  ring->epoch = monotonic_nanoseconds();
+  __atomic_store_n(&ring->magic, STREAM_MAGIC, __ATOMIC_RELEASE);
+
+  writer = new(stream_writer_t);
+  writer->ring = ring;
+  writer->mapped_size = mapped_size;
+
+  return writer;
+}
+
+void
+stream_write(stream_writer_t* writer, const uint8_t* record, size_t size) {
+  stream_ring_t* ring = writer->ring;
+  uint64_t       position = ring->written;
+  size_t         offset = position & (ring->capacity - 1);
+
+  // Records never wrap, so readers can decode straight out of the ring.
+  if(offset + size > ring->capacity) {
+    __atomic_store_n(&ring->reserved, position + ring->capacity - offset,
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    ring->data[offset] = STREAM_PAD;
+    position += ring->capacity - offset;
+    offset = 0;
+
+    __atomic_store_n(&ring->written, position, __ATOMIC_RELEASE);
+  }
+
+  __atomic_store_n(&ring->reserved, position + size, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  memcpy(ring->data + offset, record, size);
+
+  __atomic_store_n(&ring->written, position + size, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->last_record, position, __ATOMIC_RELEASE);
+}
+
+void
+stream_writer_close(stream_writer_t* writer) {
+  munmap(writer->ring, writer->mapped_size);
+  delete(writer);
+}
+
+stream_reader_t*
+stream_reader_open(const char* path) {
+  stream_reader_t* reader;
+  stream_ring_t*   ring;
+  struct stat      info;
+  int              fd = open(path, O_RDONLY);
+
+  if(fd < 0 || fstat(fd, &info) != 0 ||
+     (size_t)info.st_size < sizeof(stream_ring_t))
+  {
+    logmsg("Unable to open stream ring %s.", path);
+    if(fd >= 0) {
+      close(fd);
+    }
+    return NULL;
+  }
+
+  ring = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(ring == MAP_FAILED) {
+    logmsg("Unable to map stream ring %s.", path);
+    return NULL;
+  }
+
+  if(__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != STREAM_MAGIC ||
+     sizeof(stream_ring_t) + ring->capacity != (size_t)info.st_size)
+  {
+    logmsg("%s isn't a stream ring.", path);
+    munmap(ring, info.st_size);
+    return NULL;
+  }
+
+  reader = new(stream_reader_t);
+  reader->ring = ring;
+  reader->mapped_size = info.st_size;
+  reader->position = __atomic_load_n(&ring->last_record, __ATOMIC_ACQUIRE);
+
+  return reader;
+}
+
+/**
+   Skips to the newest record after falling too far behind.
+*/
+static void
+skip_to_newest(stream_reader_t* reader) {
+  reader->position = __atomic_load_n(&reader->ring->last_record,
+                                     __ATOMIC_ACQUIRE);
+  reader->chunk_size = 0;
+  reader->chunk_offset = 0;
+  reader->laps++;
+}
+
+/**
+   Copies the next run of written bytes out of the ring.
+
+   @return
+     False if there's nothing new.
+*/
+static bool
+fill_chunk(stream_reader_t* reader) {
+  stream_ring_t* ring = reader->ring;
+
+  while(true) {
+    uint64_t written = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+    size_t   offset = reader->position & (ring->capacity - 1);
+    size_t   size;
+
+    if(written == reader->position) {
+      return false;
+    } else if(written - reader->position > ring->capacity) {
+      skip_to_newest(reader);
+      continue;
+    }
+
+    size = min(min(written - reader->position, ring->capacity - offset),
+               STREAM_READ_SIZE);
+    memcpy(reader->chunk, ring->data + offset, size);
+
+    // If the writer reserved past where the copy started plus a ring, some
+    // of it may have been overwritten while it was copied.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&ring->reserved, __ATOMIC_RELAXED) -
+       reader->position > ring->capacity)
+    {
+      skip_to_newest(reader);
+      continue;
+    }
+
+    reader->chunk_size = size;
+    reader->chunk_offset = 0;
+    return true;
+  }
+}
+
+bool
+stream_next(stream_reader_t* reader, stream_record_t* record) {
+  while(true) {
+    if(reader->chunk_offset < reader->chunk_size) {
+      size_t used = stream_decode(reader->chunk + reader->chunk_offset,
+                                  reader->chunk_size - reader->chunk_offset,
+                                  record);
+
+      if(used > 0 && record->kind == STREAM_PAD) {
+        // On to the start of the ring.
+        reader->position += reader->ring->capacity -
+          (reader->position & (reader->ring->capacity - 1));
+        reader->chunk_size = 0;
+        continue;
+      } else if(used > 0) {
+        reader->chunk_offset += used;
+        reader->position += used;
+        return true;
+      } else if(reader->chunk_offset == 0) {
+        // Whole records are always committed, so this isn't one.
+        skip_to_newest(reader);
+        continue;
+      }
+    }
+
+    // The chunk is used up or ends inside a record.
+    if(!fill_chunk(reader)) {
+      return false;
+    }
+  }
+}
+
+uint64_t
+stream_backlog(stream_reader_t* reader) {
+  return __atomic_load_n(&reader->ring->written, __ATOMIC_ACQUIRE) -
+    reader->position;
+}
+
+void
+stream_reader_close(stream_reader_t* reader) {
+  munmap(reader->ring, reader->mapped_size);
+  delete(reader);
+}
@@ -0,0 +1,180 @@
+/**
+   @file stream.h
+
+   Live move stream for spectators.  A publisher writes records describing
+   games as they're played into a ring in shared memory, and any number of
+   subscriber processes read it at their own pace, rebuilding the boards
+   themselves.  Publishing costs the same however many subscribers there
+   are, since nothing is sent to them individually.
+
+   Records are packed, with numbers as LEB128 varints.  The low two bits of
+   the first byte give the kind:
+
+     STREAM_PAD       Nothing more is written before the end of the ring.
+     STREAM_MOVES     Bits 2-7 hold the number of moves less one.  Then the
+                      game id, the moves as 2-bit direction_t values four to
+                      a byte, and for each move the milliseconds since the
+                      game's previous move or keyframe.
+     STREAM_KEYFRAME  Then the game id, milliseconds since the ring was
+                      created, the move count, the board size and the cells
+                      packed five bits each, lowest bits first.
+     STREAM_END       Then the game id of a game that has ended.
+
+   A subscriber follows a game once it has seen a keyframe for it, and
+   applies moves from there.  Subscribers that fall a whole ring behind skip
+   ahead and wait for keyframes again.
+*/
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../board.h"
+
+/** Most moves in one STREAM_MOVES record. */
+#define STREAM_MAX_MOVES 64
+
+/** Longest record, a full STREAM_MOVES one. */
+#define STREAM_MAX_RECORD (1 + 10 + STREAM_MAX_MOVES / 4 + \
+                           STREAM_MAX_MOVES * 5)
+
+/** Bytes a reader copies out of the ring at a time. */
+#define STREAM_READ_SIZE 16384
+
+typedef enum stream_kind {
+  STREAM_PAD      = 0,
+  STREAM_MOVES    = 1,
+  STREAM_KEYFRAME = 2,
+  STREAM_END      = 3
+} stream_kind_t;
+
+/**
+   One decoded record.  Only the fields for its kind are filled in.
+*/
+typedef struct stream_record {
+  stream_kind_t kind;
+  uint64_t      game;
+
+  /** STREAM_KEYFRAME: milliseconds since the ring was created. */
+  uint64_t      time;
+  uint32_t      move_count;
+  board_t       board;
+
+  /** STREAM_MOVES */
+  int           count;
+  uint8_t       directions[STREAM_MAX_MOVES];
+  uint32_t      delays[STREAM_MAX_MOVES];
+} stream_record_t;
+
+typedef struct stream_ring stream_ring_t;
+
+/**
+   Writes records to a ring.  Only one thread may write at a time.
+*/
+typedef struct stream_writer {
+  stream_ring_t* ring;
+  size_t         mapped_size;
+} stream_writer_t;
+
+/**
+   Follows a ring on behalf of one subscriber.
+*/
+typedef struct stream_reader {
+  stream_ring_t* ring;
+  size_t         mapped_size;
+
+  /** Ring position of the next record to decode. */
+  uint64_t       position;
+
+  /** Records copied out of the ring, not all decoded yet. */
+  uint8_t        chunk[STREAM_READ_SIZE];
+  size_t         chunk_size;
+  size_t         chunk_offset;
+
+  /** 
+      Times the writer got a whole ring ahead and the reader skipped to the
+      newest record.  Boards being followed may have missed moves.
+  */
+  uint64_t       laps;
+} stream_reader_t;
+
+/**
+   Encodes a record.
+
+   @param buffer
+     Receives the record, up to STREAM_MAX_RECORD bytes.
+   @return
+     Size of the record.
+*/
+size_t
+stream_encode(const stream_record_t* record, uint8_t* buffer);
+
+/**
+   Decodes the record at the start of a buffer.
+
+   @return
+     Bytes the record took, or 0 if the buffer ends inside it or it isn't
+     valid.
+*/
+size_t
+stream_decode(const uint8_t* buffer, size_t size, stream_record_t* record);
+
+/**
+   Creates a ring file, replacing any already there.  Put it under /dev/shm
+   to keep it in memory.
+
+   @param capacity
+     Bytes of records the ring holds, rounded up to a power of two.
+   @return
+     NULL if the file can't be created.
+*/
+stream_writer_t*
+stream_writer_open(const char* path, size_t capacity);
+
+/**
+   Adds one encoded record to the ring.
+*/
+void
+stream_write(stream_writer_t* writer, const uint8_t* record, size_t size);
+
+void
+stream_writer_close(stream_writer_t* writer);
+
+/**
+   Opens an existing ring, starting from its most recent record.
+
+   @return
+     NULL if the file isn't a ring.
+*/
+stream_reader_t*
+stream_reader_open(const char* path);
+
+/**
+   Gets the next record, skipping padding.
+
+   @return
+     False if there is nothing new yet.
+*/
+bool
+stream_next(stream_reader_t* reader, stream_record_t* record);
+
+/**
+   Gets the number of bytes written to the ring that the reader hasn't
+   read yet.
+*/
+uint64_t
+stream_backlog(stream_reader_t* reader);
+
+/**
+   Gets the milliseconds since a ring was created, the clock keyframe times
+   are on.
+*/
+uint64_t
+stream_time(const stream_ring_t* ring);
+
+void
+stream_reader_close(stream_reader_t* reader);
+
+#endif
@@ -0,0 +1,297 @@
+/**
+   @file verify.c
+
+   Checks submitted solutions in bulk.  Each input line holds one
+   submission:
+
+     <size> <board> <moves> [seconds]
+
+   where board is the starting position in the format read by board_parse,
+   moves is a string of U, D, L and R naming the direction each tile slid
+   and seconds is the completion time the player claims.  A submission is
+   valid when every move is legal, the final board is solved and the time,
+   if given, is a number no less than zero.  One result line is written per
+   submission, in input order, ending with the time when there is one:
+
+     valid <final board> [seconds]
+     invalid <reason> <moves applied> <final board> [seconds]
+
+   Submissions are spread over the job system's threads, one per core by
+   default.
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../board.h"
+#include "../jobs.h"
+#include "../trace.h"
+#include "../util.h"
+
+typedef struct submission {
+  char*       line;
+
+  bool        valid;
+  const char* reason;
+  size_t      applied;
+  board_t     final;
+  /** Claimed completion time, as written, or NULL if there was none. */
+  const char* time_text;
+  double      seconds;
+} submission_t;
+
+/** Submissions a job checks at a time. */
+#define VERIFY_GRAIN 256
+
+static void
+verify_submission(submission_t* submission) {
+  char* save;
+  char* size_text = strtok_r(submission->line, " \t\r", &save);
+  char* board_text = strtok_r(NULL, " \t\r", &save);
+  char* moves = strtok_r(NULL, " \t\r", &save);
+  char* time_text = strtok_r(NULL, " \t\r", &save);
+  char* end = NULL;
+
+  submission->valid = false;
+  submission->applied = 0;
+  submission->time_text = time_text;
+  submission->seconds = 0.0;
+
+  if(moves == NULL) {
+    moves = "";
+  }
+
+  if(time_text != NULL) {
+    submission->seconds = strtod(time_text, &end);
+  }
+
+  if(size_text == NULL || board_text == NULL ||
+     !board_parse(&submission->final, atoi(size_text), board_text))
+  {
+    submission->reason = "bad-board";
+    memset(&submission->final, 0, sizeof(board_t));
+  } else if(!board_apply_moves(&submission->final, moves,
+                               &submission->applied))
+  {
+    submission->reason = "illegal-move";
+  } else if(!board_is_solved(&submission->final)) {
+    submission->reason = "not-solved";
+  } else if(end != NULL && (*end != '\0' || end == time_text ||
+                            !isfinite(submission->seconds) ||
+                            submission->seconds < 0.0))
+  {
+    submission->reason = "bad-time";
+  } else {
+    submission->valid = true;
+  }
+}
+
+static void
+verify_range(void* data, int start, int end) {
+  submission_t* submissions = data;
+
+  trace_begin("verify_range");
+
+  for(int i = start; i < end; i++) {
+    verify_submission(submissions + i);
+  }
+
+  trace_end("verify_range");
+}
+
+/**
+   Reads a whole stream into a nul terminated buffer.
+*/
+static char*
+read_all(FILE* file) {
+  size_t capacity = 1 << 16;
+  size_t length = 0;
+  char*  buffer = malloc(capacity);
+
+  while(buffer != NULL) {
+    length += fread(buffer + length, 1, capacity - length - 1, file);
+
+    if(length < capacity - 1) {
+      break;
+    }
+
+    capacity *= 2;
+    buffer = realloc(buffer, capacity);
+  }
+
+  if(buffer == NULL) {
+    logmsg("Unable to allocate the input buffer.");
+    exit(1);
+  }
+
+  buffer[length] = '\0';
+  return buffer;
+}
+
+static double
+now_seconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+print_usage(void) {
+  printf("Sliding tile solution verifier.\n"
+         "verify [options] [file]\n"
+         "\n"
+         "Reads submissions from file (or stdin), one per line:\n"
+         "  <size> <comma separated tiles> <moves> [seconds]\n"
+         "\n"
+         "Options:\n"
+         "\t--(j)obs [count]   Number of worker threads.  Defaults to the "
+         "number of cores.\n"
+         "\t--(t)race [file]   Writes a chrome trace of the run to file.\n");
+}
+
+int main(int argc, char** argv) {
+  FILE*          input = stdin;
+  char*          text;
+  submission_t*  submissions;
+  size_t         count = 0;
+  size_t         capacity = 1024;
+  size_t         total_moves = 0;
+  size_t         valid_count = 0;
+  size_t         timed_count = 0;
+  double         fastest = 0.0;
+  double         total_seconds = 0.0;
+  long           jobs = jobs_core_count();
+  const char*    trace_filename = NULL;
+  double         start_time;
+  double         elapsed;
+
+  for(int i = 1; i < argc; i++) {
+    if((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0)
+       && i + 1 < argc)
+    {
+      jobs = atol(argv[++i]);
+    }
+
+    else if((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--trace") == 0)
+            && i + 1 < argc)
+    {
+      trace_filename = argv[++i];
+    }
+
+    else if(argv[i][0] != '-' && input == stdin) {
+      input = fopen(argv[i], "rt");
+      if(input == NULL) {
+        printf("Cannot open %s\n", argv[i]);
+        return 1;
+      }
+    }
+
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if(jobs < 1) {
+    jobs = 1;
+  }
+
+  if(trace_filename != NULL) {
+    trace_init(trace_filename);
+    trace_thread_name("main");
+  }
+
+  jobs_init(jobs - 1);
+
+  // Split the input into lines, skipping blank ones
+  trace_begin("read_input");
+  text = read_all(input);
+  submissions = new_array(submission_t, capacity);
+
+  for(char* line = strtok(text, "\n"); line != NULL;
+      line = strtok(NULL, "\n"))
+  {
+    if(strspn(line, " \t\r") == strlen(line)) {
+      continue;
+    }
+
+    if(count == capacity) {
+      capacity *= 2;
+      submissions = realloc(submissions, capacity * sizeof(submission_t));
+      if(submissions == NULL) {
+        logmsg("Unable to grow the submission list.");
+        exit(1);
+      }
+    }
+
+    submissions[count++].line = line;
+  }
+
+  trace_end("read_input");
+
+  start_time = now_seconds();
+  jobs_parallel_for(verify_range, submissions, count, VERIFY_GRAIN);
+  elapsed = now_seconds() - start_time;
+
+  for(size_t i = 0; i < count; i++) {
+    submission_t* submission = submissions + i;
+    char          board_text[BOARD_MAX_CELLS * 3 + 1] = "-";
+    const char*   time_text = "";
+
+    if(submission->final.size != 0) {
+      board_format(&submission->final, board_text, sizeof(board_text));
+    }
+
+    // The claimed time is echoed back as written.
+    if(submission->time_text != NULL) {
+      time_text = submission->time_text;
+    }
+
+    if(submission->valid) {
+      printf("valid %s%s%s\n", board_text, time_text[0] ? " " : "",
+             time_text);
+      valid_count++;
+
+      if(submission->time_text != NULL) {
+        if(timed_count == 0 || submission->seconds < fastest) {
+          fastest = submission->seconds;
+        }
+        total_seconds += submission->seconds;
+        timed_count++;
+      }
+    } else {
+      printf("invalid %s %zu %s%s%s\n", submission->reason,
+             submission->applied, board_text, time_text[0] ? " " : "",
+             time_text);
+    }
+
+    total_moves += submission->applied;
+  }
+
+  fprintf(stderr, "%zu submissions (%zu valid), %zu moves in %.6f s on %d "
+          "threads: %.0f moves/s\n", count, valid_count, total_moves, elapsed,
+          jobs_thread_count(), elapsed > 0 ? total_moves / elapsed : 0.0);
+
+  if(timed_count > 0) {
+    fprintf(stderr, "%zu valid completion times: fastest %.3f s, average "
+            "%.3f s\n", timed_count, fastest, total_seconds / timed_count);
+  }
+
+  if(input != stdin) {
+    fclose(input);
+  }
+
+  jobs_shutdown();
+  free(submissions);
+  free(text);
+
+  trace_shutdown();
+
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+
+#include "util.h"
+#include "profile.h"
+#include "trace.h"
+
+typedef struct trace_event {
+  const char* name;
+  /** Chrome's event type: B(egin), E(nd), C(ounter) or M(etadata). */
+  char        phase;
+  int         thread;
+  double      time;
+  double      value;
+} trace_event_t;
+
+static struct {
+  bool           enabled;
+  const char*    filename;
+  double         start_time;
+
+  trace_event_t* events;
+  /** 
+      Slots handed out so far.  Stops growing once it reaches
+      TRACE_MAX_EVENTS, give or take the threads racing for the last slot.
+  */
+  unsigned int   count;
+  /** Events that arrived after the buffer filled. */
+  unsigned long  dropped;
+  int            thread_count;
+} trace;
+
+/** Small per-thread number used as the trace's thread id.  0 until used. */
+static __thread int trace_thread;
+
+static int
+current_thread(void) {
+  if(trace_thread == 0) {
+    trace_thread = __sync_add_and_fetch(&trace.thread_count, 1);
+  }
+
+  return trace_thread;
+}
+
+static void
+add_event(char phase, const char* name, double value) {
+  if(trace.enabled) {
+    unsigned int index = TRACE_MAX_EVENTS;
+
+    // A full buffer isn't added to, so the count can't wrap on long runs.
+    if(__atomic_load_n(&trace.count, __ATOMIC_RELAXED) < TRACE_MAX_EVENTS) {
+      index = __sync_fetch_and_add(&trace.count, 1);
+    }
+
+    if(index >= TRACE_MAX_EVENTS) {
+      __sync_fetch_and_add(&trace.dropped, 1);
+    } else {
+      trace_event_t* event = trace.events + index;
+
+      event->name = name;
+      event->phase = phase;
+      event->thread = current_thread();
+      event->time = profile_now() - trace.start_time;
+      event->value = value;
+    }
+  }
+}
+
+bool
+trace_init(const char* filename) {
+  trace.events = new_array(trace_event_t, TRACE_MAX_EVENTS);
+  trace.filename = filename;
+  trace.start_time = profile_now();
+  trace.count = 0;
+  trace.dropped = 0;
+  trace.enabled = trace.events != NULL;
+
+  return trace.enabled;
+}
+
+/**
+   Writes a name as a JSON string.  Names are expected to be plain, but
+   quotes and backslashes are escaped so the file always parses.
+*/
+static void
+write_name(FILE* file, const char* name) {
+  fputc('"', file);
+
+  for(const char* c = name; *c != '\0'; c++) {
+    if(*c == '"' || *c == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*c, file);
+  }
+
+  fputc('"', file);
+}
+
+void
+trace_shutdown(void) {
+  FILE* file;
+  int   count;
+
+  if(!trace.enabled) {
+    return;
+  }
+
+  trace.enabled = false;
+  count = trace.count < TRACE_MAX_EVENTS ? (int)trace.count : TRACE_MAX_EVENTS;
+
+  file = fopen(trace.filename, "wt");
+  if(file == NULL) {
+    logmsg("Unable to open %s to write the trace.", trace.filename);
+  } else {
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for(int i = 0; i < count; i++) {
+      trace_event_t* event = trace.events + i;
+
+      fprintf(file, "{\"name\":");
+      write_name(file, event->phase == 'M' ? "thread_name" : event->name);
+      fprintf(file, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+              event->phase, event->thread, event->time * 1e6);
+
+      if(event->phase == 'C') {
+        fprintf(file, ",\"args\":{\"value\":%g}", event->value);
+      } else if(event->phase == 'M') {
+        fprintf(file, ",\"args\":{\"name\":");
+        write_name(file, event->name);
+        fprintf(file, "}");
+      }
+
+      fprintf(file, "}%s\n", i + 1 < count ? "," : "");
+    }
+
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+
+    logmsg("Wrote %d trace events to %s.", count, trace.filename);
+    if(trace.dropped > 0) {
+      logmsg("Dropped %lu trace events past the %d event limit.",
+             trace.dropped, TRACE_MAX_EVENTS);
+    }
+  }
+
+  delete(trace.events);
+  trace.events = NULL;
+}
+
+void
+trace_begin(const char* name) {
+  add_event('B', name, 0.0);
+}
+
+void
+trace_end(const char* name) {
+  add_event('E', name, 0.0);
+}
+
+void
+trace_counter(const char* name, double value) {
+  add_event('C', name, value);
+}
+
+void
+trace_thread_name(const char* name) {
+  add_event('M', name, 0.0);
+}
@@ -0,0 +1,55 @@
+/**
+   @file trace.h
+
+   Records timed events into memory and writes them out in the Chrome trace
+   event format, which chrome://tracing and ui.perfetto.dev can open.  All
+   calls do nothing until trace_init is called, and they are safe to make
+   from any thread.
+
+   Event and thread names are kept by pointer, so they must stay valid
+   until trace_shutdown.  String literals are the usual choice.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+
+/** Most events a trace holds.  Later events are dropped and counted. */
+#define TRACE_MAX_EVENTS (1 << 18)
+
+/**
+   Starts recording.
+
+   @param filename
+     File the trace is written to by trace_shutdown.
+   @return
+     False if the event buffer couldn't be allocated.
+*/
+bool trace_init(const char* filename);
+
+/**
+   Stops recording and writes the trace file.
+*/
+void trace_shutdown(void);
+
+/**
+   Marks the start of a span on the calling thread.
+*/
+void trace_begin(const char* name);
+
+/**
+   Marks the end of the innermost span on the calling thread.
+*/
+void trace_end(const char* name);
+
+/**
+   Records the value of a counter, shown as a graph over time.
+*/
+void trace_counter(const char* name, double value);
+
+/**
+   Names the calling thread in the trace.
+*/
+void trace_thread_name(const char* name);
+
+#endif